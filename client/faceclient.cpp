@@ -0,0 +1,101 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "faceclient.h"
+
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+FaceClient::FaceClient() : fd(-1) {}
+
+FaceClient::~FaceClient() { close(); }
+
+bool FaceClient::connect(const std::string &socketPath)
+{
+    close();
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (::connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void FaceClient::close()
+{
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    fd = -1;
+}
+
+bool FaceClient::isConnected() const { return fd >= 0; }
+
+bool FaceClient::evaluatePath(const std::string &imagePath, int mode,
+                              FaceWire::Response &response)
+{
+    FaceWire::Request request;
+    request.kind = FaceWire::PATH;
+    request.mode = mode;
+    request.payload = imagePath;
+    return send(request, response);
+}
+
+bool FaceClient::evaluateEncoded(const std::vector<char> &encoded, int mode,
+                                 FaceWire::Response &response)
+{
+    FaceWire::Request request;
+    request.kind = FaceWire::ENCODED;
+    request.mode = mode;
+    request.payload.assign(encoded.begin(), encoded.end());
+    return send(request, response);
+}
+
+bool FaceClient::evaluateShared(const std::string &shmName,
+                                const FaceWire::SharedImage &image, int mode,
+                                FaceWire::Response &response)
+{
+    FaceWire::Request request;
+    request.kind = FaceWire::SHARED_MEMORY;
+    request.mode = mode;
+    request.payload = FaceWire::encodeSharedImage(image, shmName);
+    return send(request, response);
+}
+
+bool FaceClient::send(const FaceWire::Request &request,
+                      FaceWire::Response &response)
+{
+    if (fd < 0) {
+        return false;
+    }
+
+    // a busy daemon answers before reading, so the write may fail while the
+    // BUSY response is still waiting to be read
+    bool written = FaceWire::writeRequest(fd, request);
+    bool read = FaceWire::readResponse(fd, response);
+    if (!read || !written || response.status == FaceWire::BUSY) {
+        close();
+    }
+    return read;
+}
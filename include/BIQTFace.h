@@ -24,6 +24,8 @@ class BIQTFace : public Provider {
     // Provider Object
     Face face;
 
+    Provider::EvaluationResult evaluateFile(const std::string &file);
+
   public:
     BIQTFace();
     ~BIQTFace() override;
@@ -27,8 +27,19 @@
 
 #include "brlandmarker.h"
 #include "cvlandmarker.h"
+#include "facemetrics.h"
+#include "facethreads.h"
+#include "facetiming.h"
+#include "facetracker.h"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
 #include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 class Face
 // class Face_LIBRARY Face
 {
@@ -114,12 +125,51 @@ class Face
         BGDeviation
     };
 
+    // resolves the model paths only, models are loaded on first use
     bool initialize(const std::string biqtPath);
+    // loads every model up front for latency sensitive callers
+    bool warmUp();
+    // loads the cascades only, which starts no thread, so a process may
+    // still fork after it (see FacePool)
+    bool warmUpCascades();
+    // initialize followed by warmUp on a loader thread the Face owns, and
+    // returns at once. Qt needs its application created and destroyed on one
+    // thread, so OpenBR is also finalized on that thread, which ~Face stops
+    // and joins. The future and the optional callback (run on the loader
+    // thread) report when OpenBR and the cascades are loaded. getQuality may
+    // be called before then: OpenBR is waited for, and a cascade the loader
+    // has not finished is loaded by the evaluation itself.
+    std::shared_future<bool>
+    initializeAsync(const std::string biqtPath,
+                    std::function<void(bool)> onReady = nullptr);
+    // false only while an initializeAsync is still loading
+    bool isReady() const;
+    // restricts face detection to the regions around skin, see CvLandmarker
+    void setSkinGuidedDetection(bool enabled);
+    // concurrent, mirrored profile detection, see CvLandmarker
+    void setSpeculativeProfileDetection(bool enabled);
+    // reads image files at their own depth rather than as 8-bit BGR, so the
+    // pixel metrics of a 16-bit capture see all of its precision. Detection
+    // and OpenBR still run on 8 bits.
+    void setAnyDepth(bool enabled);
+    // the one place to size the threads of an evaluation: the workers of
+    // getMultiFaceQuality (and of callers running faces in parallel, see
+    // getThreadBudget) and the OpenCV and OpenBR pools each worker may use,
+    // with the workers optionally pinned. Zero workers are sized from the
+    // CPUs the process may use, cgroup quota included. The pools are only
+    // capped when the workers or the threads per worker are set - they are
+    // process wide, so the last cap set wins.
+    void setThreadBudget(const FaceThreads::Budget &budget);
+    // the budget with the workers resolved
+    FaceThreads::Budget getThreadBudget() const;
     void finalize();
+    // the metrics mode reports, set to their values before evaluation
     void prepMetricsWriteMapByMode(const FaceMode mode,
                                    std::map<std::string, double> &metrics);
     // get the string result of the SAPFailure
     std::string getSapFailureStr(int sapFailure);
+    // the overall quality, -1 if the image could not be read or a cascade
+    // could not be loaded (see CvLandmarker::hasFailedCascade)
     double getQuality(const std::vector<char> &img_data,
                       std::map<std::string, double> &metrics, FaceMode mode);
     double getQuality(const std::string image_path,
@@ -127,9 +177,124 @@ class Face
     double getQuality(const cv::Mat &img,
                       std::map<std::string, double> &metrics, FaceMode mode,
                       const cv::Rect &detected_rect = cv::Rect(0, 0, 0, 0));
+    // the same with the mode fixed at compile time. Every mode is a pipeline
+    // of its own, so a LANDMARK evaluation carries none of the SHORT and FULL
+    // bookkeeping. The overloads above pick one of these by mode.
+    template <FaceMode M>
+    double getQuality(const cv::Mat &img,
+                      std::map<std::string, double> &metrics,
+                      const cv::Rect &detected_rect = cv::Rect(0, 0, 0, 0));
+
+    // anytime evaluation for a latency budget. Runs the stages of getQuality
+    // in order of value per cost - detection, landmarks, skin and OpenBR
+    // (the remaining quality formula inputs), then Background, Focus,
+    // OverExposure and Blur - and starts no stage once the deadline has
+    // passed. The metrics of skipped stages are set to NaN (not computed)
+    // and StagesCompleted counts the stages run. The quality is NaN when a
+    // formula input was skipped, -1 when a cascade could not be loaded.
+    double
+    getQualityBefore(const cv::Mat &img, std::map<std::string, double> &metrics,
+                     FaceMode mode,
+                     const std::chrono::steady_clock::time_point &deadline);
+
+    // pass/fail against the recommended re-take threshold of the quality
+    // score. The score terms are evaluated cheapest first - frontal face,
+    // SkinFace, eye/nose/mouth counts, then BrConfidence - stopping as soon as
+    // the remaining terms can no longer change the outcome. metrics holds the
+    // SHORT metrics computed so far and the QualityLowerBound and
+    // QualityUpperBound of the score. True if the score is at least threshold;
+    // false with both bounds -1 when a cascade could not be loaded.
+    bool meetsQualityThreshold(const cv::Mat &img,
+                               std::map<std::string, double> &metrics,
+                               double threshold = 4.54);
+
+    // evaluates every face in the image rather than the largest one.
+    // faceMetrics gets one record per face holding the image metrics, the
+    // metrics of that face, its Quality, FaceIndex and the FaceCount. Faces are
+    // processed on up to maxThreads threads (0 - one per core) while the
+    // whole image metrics are computed once. Returns the number of faces, -1
+    // if the image could not be read. maxThreads 0 uses the workers of the
+    // thread budget. An exception on any worker is rethrown here once every
+    // worker has stopped. -1 as well when a cascade could not be loaded.
+    int getMultiFaceQuality(
+        const std::string image_path,
+        std::vector<std::map<std::string, double>> &faceMetrics,
+        FaceMode mode, int maxThreads = 0);
+    int getMultiFaceQuality(
+        const cv::Mat &img,
+        std::vector<std::map<std::string, double>> &faceMetrics,
+        FaceMode mode, int maxThreads = 0);
+
+    // picks the best of several shots of the same subject. Every shot gets
+    // the cheap metrics (face, SAP level, landmarks, SkinFace) and shots
+    // without a frontal face are rejected. Only the topK best of the rest get
+    // OpenBR, and only while their cheap score plus the most BrConfidence can
+    // add still beats the best score so far. The winner alone gets the FULL
+    // image and face quality metrics. Each record holds the ShotScore (the
+    // cheap score below ShotStage 2) and the ShotStage reached - 0
+    // rejected, 1 cheap metrics, 2 scored with OpenBR, 3 fully evaluated.
+    // ranking lists the winner first, then the rest by ShotStage and, within
+    // a stage, by ShotScore - scores of different stages are not comparable,
+    // so a shot pruned at stage 1 is not ranked against one OpenBR scored.
+    // Returns the index of the winner, -1 if no shot has a frontal face or a
+    // cascade could not be loaded.
+    int selectBestShot(const std::vector<cv::Mat> &shots,
+                       std::vector<std::map<std::string, double>> &shotMetrics,
+                       std::vector<int> &ranking, int topK = 3);
+    int selectBestShot(const std::vector<std::string> &shotPaths,
+                       std::vector<std::map<std::string, double>> &shotMetrics,
+                       std::vector<int> &ranking, int topK = 3);
+
+    // evaluates every frame of a video or image sequence (anything
+    // cv::VideoCapture opens, e.g. "burst_%04d.png") or of an ordered list of
+    // image paths. Face detection only runs on keyframes - in between, the
+    // face is tracked and passed on as the detected_rect, until the tracking
+    // confidence drops below minTrackingConfidence. Each frame's metrics also
+    // hold its Quality, FrameIndex and whether the face was Tracked.
+    // Returns the number of frames, -1 if the source could not be opened.
+    int getSequenceQuality(
+        const std::string &source,
+        std::vector<std::map<std::string, double>> &frameMetrics,
+        FaceMode mode, int keyframeInterval = 30,
+        double minTrackingConfidence = 0.6);
+    int getSequenceQuality(
+        const std::vector<std::string> &framePaths,
+        std::vector<std::map<std::string, double>> &frameMetrics,
+        FaceMode mode, int keyframeInterval = 30,
+        double minTrackingConfidence = 0.6);
 
   private:
-    FaceMode biqtMode;
+    // set by initializeAsync
+    std::shared_future<bool> ready;
+    // the thread initializeAsync loads the models on, parked until ~Face
+    // sets stopLoader so it can finalize OpenBR
+    std::thread loader;
+    std::mutex loaderMutex;
+    std::condition_variable loaderWake;
+    bool stopLoader;
+
+    // resolved, see setThreadBudget
+    FaceThreads::Budget threadBudget;
+
+    // see setAnyDepth
+    bool anyDepth;
+    // the imread and imdecode flags
+    int readFlags() const;
+
+    // the planes of planesImage, built once per FULL evaluation of a color
+    // image and shared by detection and the skin and over-exposure setters
+    FaceMetrics::Planes planes;
+    cv::Mat planesImage;
+    // whether planes belongs to img
+    bool hasPlanes(const cv::Mat &img) const;
+
+    // brings OpenBR up before registerImage - on the loader thread of
+    // initializeAsync, waited for, or else on the calling thread. Called
+    // ahead of every parallel section, so OpenBR is never started (and later
+    // finalized) on different threads.
+    void startOpenBr();
+    // builds the planes of img in FULL mode, clears them otherwise
+    template <FaceMode M> void convertPlanes(const cv::Mat &img);
 
     CvLandmarker cvLandmarker;
     BrLandmarker brLandmarker;
@@ -143,15 +308,23 @@ class Face
                      std::map<std::string, double> &metrics);
     void setArea(const cv::Mat &img, std::map<std::string, double> &metrics);
     void setRatio(const cv::Mat &img, std::map<std::string, double> &metrics);
+    // the image metrics of mode M
+    template <FaceMode M>
+    void setImageMetrics(const cv::Mat &img,
+                         std::map<std::string, double> &metrics);
     void setFace(const cv::Mat &img, std::map<std::string, double> &metrics,
                  const std::vector<CvLandmarker::LandmarkFace> &landmarkFaces);
+    template <FaceMode M>
     void setCvNumLandmarks(std::map<std::string, double> &metrics,
                            const CvLandmarker::LandmarkFace &landmarkFace);
+    template <FaceMode M>
     void setEyeCount(const cv::Mat &img, std::map<std::string, double> &metrics,
                      const CvLandmarker::LandmarkFace &landmarkFace);
+    template <FaceMode M>
     void setNoseCount(const cv::Mat &img,
                       std::map<std::string, double> &metrics,
                       const CvLandmarker::LandmarkFace &landmarkFace);
+    template <FaceMode M>
     void setMouthCount(const cv::Mat &img,
                        std::map<std::string, double> &metrics,
                        const CvLandmarker::LandmarkFace &landmarkFace);
@@ -161,6 +334,9 @@ class Face
                          bool useFaceRect);
     void setFocus(const cv::Mat &img, std::map<std::string, double> &metrics,
                   bool useFaceRect);
+    void setSkinFull(const cv::Mat &img,
+                     std::map<std::string, double> &metrics);
+    template <FaceMode M>
     void setFaceOffset(const cv::Mat &img,
                        std::map<std::string, double> &metrics);
     void setBackground(const cv::Mat &img,
@@ -168,9 +344,43 @@ class Face
     void setBlur(const cv::Mat &img, std::map<std::string, double> &metrics,
                  bool useFaceRect);
     void setSAPLevel(std::map<std::string, double> &metrics);
+    template <FaceMode M>
     void setOpenBrMetrics(const cv::Mat &img,
                           std::map<std::string, double> &metrics);
     void setMetricsWriteMap(std::string name, int index);
+    template <FaceMode M>
+    double setFaceMetrics(
+        const cv::Mat &img, std::map<std::string, double> &metrics,
+        const std::vector<CvLandmarker::LandmarkFace> &landmarkFaces);
+    template <FaceMode M>
+    void setCvFaceMetrics(
+        const cv::Mat &img, std::map<std::string, double> &metrics,
+        const std::vector<CvLandmarker::LandmarkFace> &landmarkFaces);
+    void setFaceQualityMetrics(const cv::Mat &img,
+                               std::map<std::string, double> &metrics);
+    void setImageQualityMetrics(const cv::Mat &img,
+                                std::map<std::string, double> &metrics);
+    double scoreQuality(std::map<std::string, double> &metrics);
+    std::vector<CvLandmarker::LandmarkFace>
+    detectLargestFace(const cv::Mat &img, cv::Mat &imgGray);
+    template <FaceMode M>
+    double getQualityBefore(
+        const cv::Mat &img, std::map<std::string, double> &metrics,
+        const std::chrono::steady_clock::time_point &deadline);
+    template <FaceMode M>
+    int getMultiFaceQuality(
+        const cv::Mat &img,
+        std::vector<std::map<std::string, double>> &faceMetrics,
+        int maxThreads);
+    int evaluateSequence(
+        const std::function<bool(cv::Mat &)> &nextFrame,
+        std::vector<std::map<std::string, double>> &frameMetrics,
+        FaceMode mode, int keyframeInterval, double minTrackingConfidence);
+    template <FaceMode M>
+    int evaluateSequence(
+        const std::function<bool(cv::Mat &)> &nextFrame,
+        std::vector<std::map<std::string, double>> &frameMetrics,
+        int keyframeInterval, double minTrackingConfidence);
 };
 
 #endif // Face_H
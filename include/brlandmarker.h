@@ -35,6 +35,7 @@
 #include "openbr/openbr_plugin.h"
 
 #include <iostream>
+#include <mutex>
 
 class BrLandmarker
 // class BRLANDMARKER_LIBRARY BrLandmarker
@@ -56,10 +57,29 @@ class BrLandmarker
         double DFFS; //(facenes or distance from face space, smaller is better)
     };
 
+    // only resolves the sdk path - OpenBR itself is initialized by warmUp,
+    // which must have run before registerImage, on the thread that will
+    // also release it
     void initialize(const std::string path);
+    void warmUp();
+    // drops this instance's reference on OpenBR, finalizing it when no other
+    // instance uses it - call it on the thread warmUp ran on, as Qt wants.
+    // The destructor does the same for an instance still holding one.
+    void release();
+    // caps the threads of OpenBR (its parallelism and the Qt global thread
+    // pool), process wide. Applied now if OpenBR is running, else once it
+    // starts - its initialization resets both. 0 leaves OpenBR's defaults.
+    static void setMaxThreads(int threads);
     std::map<std::string, int> registerImage(const cv::Mat &img,
                                              const QRectF &faceRect,
                                              bool useASEF, bool forceDetection);
+
+  private:
+    void ensureInitialized();
+
+    std::string sdkPath;
+    // true once this instance holds a reference on the process wide context
+    bool initialized;
 };
 
 #endif // BRLANDMARKER_H
@@ -0,0 +1,84 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef CASCADEBUNDLE_H
+#define CASCADEBUNDLE_H
+
+#include "opencv2/objdetect/objdetect.hpp"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * A single file holding every cascade used by the CvLandmarker, already
+ * converted to the current OpenCV cascade format and stripped of comments.
+ *
+ * The bundle is generated at build time by biqt-face-cascade-bundle and is
+ * memory-mapped when opened. Old-format haar cascades otherwise have to be
+ * parsed and converted on every load.
+ *
+ * Layout (host byte order):
+ * @verbatim
+ *  char[8]  magic "BQFCSB02"
+ *  uint32   entry count
+ *  entries: uint32 name length, name, uint64 source xml size,
+ *           int64 source xml mtime (seconds), uint64 source xml hash,
+ *           uint64 payload offset, uint64 payload length
+ *  payloads
+ * @endverbatim
+ */
+class CascadeBundle {
+  public:
+    struct Entry {
+        std::string name; // path relative to the config directory
+        uint64_t sourceSize;
+        int64_t sourceMtime;
+        uint64_t sourceHash;
+        std::string payload;
+    };
+
+    CascadeBundle();
+    ~CascadeBundle();
+
+    bool open(const std::string &bundlePath);
+    void close();
+    bool isOpen() const;
+
+    // loads the named cascade into the classifier, returns false if the
+    // entry is missing, stale or could not be read. The entry is stale when
+    // the size of the xml on disk differs, or its mtime and then its hash do
+    // - a copy that only lost its mtime still uses the bundle.
+    bool load(const std::string &name, const std::string &xmlPath,
+              cv::CascadeClassifier &classifier) const;
+
+    static bool write(const std::string &bundlePath,
+                      const std::vector<Entry> &entries);
+    // the hash of a source xml, 64-bit FNV-1a
+    static uint64_t hash(const std::string &data);
+
+  private:
+    struct Location {
+        uint64_t sourceSize;
+        int64_t sourceMtime;
+        uint64_t sourceHash;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    void *mapped;
+    size_t mappedSize;
+    std::map<std::string, Location> locations;
+
+    CascadeBundle(const CascadeBundle &);
+    CascadeBundle &operator=(const CascadeBundle &);
+};
+
+#endif // CASCADEBUNDLE_H
@@ -26,11 +26,18 @@
 //     #endif
 // #endif
 
+#include "cascadebundle.h"
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/objdetect/objdetect.hpp"
 #include "opencv2/opencv.hpp"
+#include <atomic>
+#include <condition_variable>
 #include <ctime>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 class CvLandmarker
 // class CVLANDMARKER_LIBRARY CvLandmarker
@@ -39,7 +46,38 @@ class CvLandmarker
     CvLandmarker();
     ~CvLandmarker();
 
+    // the cascades used by the landmarker, each is loaded on first use
+    enum Cascade {
+        HAAR_FACE,         // haarcascade_frontalface_alt2.xml
+        HAAR_PROFILE_FACE, // haarcascade_profileface.xml
+        LBP_FACE,          // cascade.xml -trained
+        EYE_PAIR,          // haarcascade_mcs_eyepair_big.xml
+        LEFT_EYE,          // haarcascade_mcs_lefteye.xml
+        RIGHT_EYE,         // haarcascade_mcs_righteye.xml
+        NOSE,              // haarcascade_mcs_nose.xml
+        MOUTH,             // haarcascade_mcs_mouth.xml
+        CASCADE_COUNT
+    };
+
+    // only resolves and checks the cascade paths - nothing is parsed until a
+    // cascade is first needed or warmUp is called
     bool initialize(std::string cascadesPath);
+    // loads every cascade getLandmarksNonThreaded can use, the profile
+    // cascade is only needed when no frontal face is found
+    bool warmUp(bool includeProfile = true);
+    // true once a cascade has failed to load - detection or landmarking ran
+    // without it, so a face not found may be missing rather than absent
+    bool hasFailedCascade();
+    // when enabled the face cascades only search the regions around skin
+    // found in a downscaled copy of the image, falling back to the whole
+    // image when there is no such region or no face in them
+    void setSkinGuidedDetection(bool enabled);
+    // when enabled the profile cascade runs on a separate thread alongside
+    // the frontal one instead of after it, and searches the mirrored image
+    // as well so faces turned either way are found. It is cancelled (and not
+    // waited for) when a frontal face is found. Only so many run at once -
+    // beyond that the profile cascade runs after the frontal one as usual.
+    void setSpeculativeProfileDetection(bool enabled);
 
     struct LandmarkFace {
         bool containsLandmarks;
@@ -67,32 +105,128 @@ class CvLandmarker
 
     void checkRectOutOfBounds(const cv::Mat &img, cv::Rect &rect);
     // if no detected rect passed in the area will be zero and face detection
-    // will be performed
+    // will be performed. gray may hold the BGR2GRAY conversion of a color
+    // img (see FaceMetrics::convert) to save converting it again.
     LandmarkResult getLandmarksNonThreaded(
         const cv::Mat &img, bool printLandmarks, bool showPreviews,
-        const cv::Rect &detected_rect = cv::Rect(0, 0, 0, 0));
+        const cv::Rect &detected_rect = cv::Rect(0, 0, 0, 0),
+        const cv::Mat &gray = cv::Mat());
+
+    // multi-face landmarking. prepareGray builds the equalized gray image the
+    // cascades run on, detectFaces finds every frontal face in it (or every
+    // profile face when there is no frontal one). landmarkFace may then be
+    // called for several faces at once from different threads.
+    void prepareGray(const cv::Mat &img, cv::Mat &imgGray,
+                     const cv::Mat &gray = cv::Mat());
+    std::vector<cv::Rect> detectFaces(const cv::Mat &img,
+                                      const cv::Mat &imgGray, bool &isProfile);
+    LandmarkFace landmarkFace(const cv::Mat &img, const cv::Mat &imgGray,
+                              const cv::Rect &faceRect);
 
   private:
-    cv::CascadeClassifier haarFaceCascade;
-    cv::CascadeClassifier haarProfileFaceCascade;
-    cv::CascadeClassifier lbpFaceCascade;
-    cv::CascadeClassifier eyeCascade;
-    cv::CascadeClassifier leftEyeCascade;
-    cv::CascadeClassifier rightEyeCascade;
-    cv::CascadeClassifier eyePairCascade;
-    cv::CascadeClassifier noseCascade;
-    cv::CascadeClassifier mouthCascade;
-
-    std::string face_haar_cascade;         // haarcascade_frontalface_alt2.xml";
-    std::string face_haar_profile_cascade; // haarcascade_profileface.xml";
-    std::string face_lbp_cascade;          // cascade.xml"; -trained
-    std::string eye_pair_cascade;          // haarcascade_mcs_eyepair_big.xml";
-    std::string left_eye_cascade;          // haarcascade_mcs_lefteye.xml";
-    std::string right_eye_cascade;         // haarcascade_mcs_righteye.xml";
-    std::string
-        nose_cascade; // = "cascades/haarcascades/haarcascade_mcs_nose.xml";
-    std::string
-        mouth_cascade; // = "cascades/haarcascades/haarcascade_mcs_mouth.xml";
+    // detectMultiScale is not safe to call on one classifier from several
+    // threads, so each concurrent caller gets a set of its own
+    struct CascadeSet {
+        CascadeSet();
+        cv::CascadeClassifier cascades[CASCADE_COUNT];
+        bool loaded[CASCADE_COUNT];
+    };
+
+    cv::CascadeClassifier *getCascade(CascadeSet &set, Cascade cascade);
+    bool detect(CascadeSet &set, Cascade cascade, const cv::Mat &img,
+                std::vector<cv::Rect> &found, double scaleFactor,
+                int minNeighbors, int flags, cv::Size minSize = cv::Size());
+    void faceRegions(const cv::Mat &img, cv::Size minSize,
+                     std::vector<cv::Rect> &regions);
+    // a profile detection running on a thread of its own. Dropping it
+    // cancels the detection.
+    class Speculation {
+      public:
+        Speculation() {}
+        Speculation(Speculation &&other) = default;
+        Speculation &operator=(Speculation &&other) = default;
+        ~Speculation() { cancel(); }
+
+        // false if no detection was started
+        bool valid() const { return result.valid(); }
+        // waits for the faces found, rethrowing an error of the detection
+        std::vector<cv::Rect> get() const { return result.get(); }
+        // stops the detection at its next cascade pass, its result unused
+        void cancel()
+        {
+            if (cancelled) {
+                *cancelled = true;
+            }
+        }
+
+      private:
+        friend class CvLandmarker;
+        std::shared_future<std::vector<cv::Rect>> result;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+    };
+
+    // cancelled may stop a detection early, with nothing found
+    void detectProfile(CascadeSet &set, const cv::Mat &imgGray,
+                       const std::vector<cv::Rect> &regions,
+                       std::vector<cv::Rect> &found, int flags,
+                       cv::Size minSize,
+                       const std::atomic<bool> *cancelled = NULL);
+    Speculation speculateProfile(const cv::Mat &imgGray,
+                                 const std::vector<cv::Rect> &regions,
+                                 int flags, cv::Size minSize);
+    void detectInRegions(CascadeSet &set, Cascade cascade,
+                         const cv::Mat &imgGray,
+                         const std::vector<cv::Rect> &regions,
+                         std::vector<cv::Rect> &found, int flags,
+                         cv::Size minSize,
+                         const std::atomic<bool> *cancelled = NULL);
+    bool isCancelled(const std::atomic<bool> *cancelled) const;
+    CascadeSet *acquireCascadeSet();
+    void releaseCascadeSet(CascadeSet *set);
+    // holds a set from acquireCascadeSet until it goes out of scope, so an
+    // exception cannot keep the set out of the free list
+    class CascadeLease {
+      public:
+        explicit CascadeLease(CvLandmarker &landmarker)
+            : landmarker(landmarker), set(landmarker.acquireCascadeSet())
+        {
+        }
+        ~CascadeLease() { landmarker.releaseCascadeSet(set); }
+        CascadeSet &operator*() const { return *set; }
+
+      private:
+        CascadeLease(const CascadeLease &);
+        CascadeLease &operator=(const CascadeLease &);
+
+        CvLandmarker &landmarker;
+        CascadeSet *set;
+    };
+    LandmarkFace findLandmarks(CascadeSet &set, const cv::Mat &img,
+                               const cv::Mat &imgGray, const cv::Rect &faceRect,
+                               bool showPreviews, cv::Mat &imgPreview);
+
+    // optional precompiled cascades, kept mapped for lazy loads
+    CascadeBundle cascadeBundle;
+    std::string configDir;
+    std::atomic<bool> skinGuided;
+    std::atomic<bool> speculativeProfile;
+
+    // guards the set lists, the speculations and cascadeFailed below - it is
+    // never held while a cascade is parsed, a leased set loads on its own
+    std::mutex cascadeMutex;
+    // warmUp loads the first set, more are only created while several
+    // threads landmark at once
+    std::vector<std::unique_ptr<CascadeSet>> cascadeSets;
+    std::vector<CascadeSet *> freeCascadeSets;
+    // profile detections still running on their own thread, at most
+    // maxSpeculating
+    int speculating;
+    int maxSpeculating;
+    std::condition_variable speculationDone;
+    // set by the destructor to cancel every speculation
+    std::atomic<bool> stopping;
+    std::string cascadePaths[CASCADE_COUNT];
+    bool cascadeFailed[CASCADE_COUNT];
 };
 
 #endif // CVLANDMARKER_H
@@ -12,6 +12,7 @@
 #define CV_SKINCOLOR_CBCR_INCLUDED
 
 #include <opencv2/core/core.hpp>
+#include <vector>
 
 /**
  * Skin Color Detection in (Cb, Cr) space by [1][2]
@@ -31,4 +32,29 @@
 
 void cvSkinColorCrCb(const cv::Mat &img, cv::Mat &mask);
 
+// the two implementations behind cvSkinColorCrCb, picked by the
+// FaceMetrics backend - the original per pixel computation, and a lookup of
+// the same test precomputed for every (Cr, Cb) pair. Only the latter takes
+// the gray and 16-bit formats of FaceMetrics::supported.
+void cvSkinColorCrCbReference(const cv::Mat &img, cv::Mat &mask);
+void cvSkinColorCrCbTable(const cv::Mat &img, cv::Mat &mask);
+// the lookup on the calling thread alone, for a stripe of a parallel loop
+// that must not start another one
+void cvSkinColorCrCbRows(const cv::Mat &img, cv::Mat &mask);
+// the 256 x 256 table of that lookup, indexed by Cr * 256 + Cb
+const uchar *cvSkinColorCrCbLookup();
+
+/**
+ * Candidate face regions from the skin mask of a downscaled copy of the image.
+ * Regions are padded for the hair and background around a face, merged where
+ * they overlap and never smaller than minSize.
+ *
+ * @param img     Input image (BGR or BGRA, 8 or 16 bits), no regions for
+ *                any other image
+ * @param minSize Smallest face of interest
+ * @param regions The regions, in image coordinates
+ */
+void cvSkinRegions(const cv::Mat &img, cv::Size minSize,
+                   std::vector<cv::Rect> &regions);
+
 #endif
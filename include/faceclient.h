@@ -0,0 +1,56 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef FACECLIENT_H
+#define FACECLIENT_H
+
+#include "facewire.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Thin client for the biqt-face-daemon. Only depends on the FaceWire framing,
+ * not on OpenCV or OpenBR.
+ *
+ * Every evaluate call returns false if the daemon could not be reached or
+ * the connection dropped. Otherwise the outcome is in response.status -
+ * FaceWire::BUSY means the daemon turned the connection away and the client
+ * has to connect again.
+ */
+class FaceClient {
+  public:
+    FaceClient();
+    ~FaceClient();
+
+    bool connect(const std::string &socketPath);
+    void close();
+    bool isConnected() const;
+
+    // mode is a Face::FaceMode
+    bool evaluatePath(const std::string &imagePath, int mode,
+                      FaceWire::Response &response);
+    bool evaluateEncoded(const std::vector<char> &encoded, int mode,
+                         FaceWire::Response &response);
+    // pixels already decoded into the shared memory object shmName
+    bool evaluateShared(const std::string &shmName,
+                        const FaceWire::SharedImage &image, int mode,
+                        FaceWire::Response &response);
+
+  private:
+    bool send(const FaceWire::Request &request, FaceWire::Response &response);
+
+    int fd;
+
+    FaceClient(const FaceClient &);
+    FaceClient &operator=(const FaceClient &);
+};
+
+#endif // FACECLIENT_H
@@ -0,0 +1,65 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef FACEDAEMON_H
+#define FACEDAEMON_H
+
+#include "Face.h"
+#include "facepool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+
+/**
+ * Keeps an initialized Face warm behind a UNIX domain socket so short lived
+ * callers (see FaceClient) do not pay for loading the models.
+ *
+ * Evaluation runs in a FacePool. Each connection gets a thread that serves
+ * its FaceWire requests in order. Connections beyond maxClients are answered
+ * with FaceWire::BUSY and closed. The socket is created with owner-only
+ * permissions and nothing is ever exposed beyond the local host.
+ */
+class FaceDaemon {
+  public:
+    FaceDaemon();
+    ~FaceDaemon();
+
+    // initializes the models, forks the workers of the budget and binds the
+    // socket - call before the process starts any other thread (see
+    // FacePool::start)
+    bool start(const std::string &socketPath,
+               const FaceThreads::Budget &budget, int maxClients);
+    // serves connections until stop() is called
+    void run();
+    // thread safe, closes every connection and waits for them to finish
+    void stop();
+
+  private:
+    void serve(int clientFd);
+
+    Face face;
+    FacePool pool;
+    std::string socketPath;
+    int listenFd;
+    int maxClients;
+    std::atomic<bool> stopping;
+
+    std::mutex clientsMutex;
+    std::condition_variable clientsDone;
+    std::set<int> clients;
+
+    FaceDaemon(const FaceDaemon &);
+    FaceDaemon &operator=(const FaceDaemon &);
+};
+
+#endif // FACEDAEMON_H
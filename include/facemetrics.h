@@ -0,0 +1,118 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef FACEMETRICS_H
+#define FACEMETRICS_H
+
+#include "opencv2/core/core.hpp"
+
+/**
+ * The pixel metrics behind the quality setters of Face, free of the metrics
+ * map so they can be benchmarked and compared on their own. Each takes the
+ * region it is computed over - the face or the whole image.
+ *
+ * There are two implementations of each. Reference holds the original
+ * ones and is the ground truth, Optimized the faster ones that are used by
+ * default. biqt-face-equivalence checks that they agree.
+ */
+namespace FaceMetrics {
+
+enum Backend { REFERENCE, OPTIMIZED };
+
+// process wide, also picks the cvSkinColorCrCb implementation
+void setBackend(Backend backend);
+Backend backend();
+
+/*
+ * the metrics take gray, BGR and BGRA images of 8 or 16 bits, with a kernel
+ * per format picked once per image. A 16-bit image is measured in 8-bit
+ * units without being converted: its metrics are those of the 8-bit image
+ * but for what rounding to 8 bits would have lost. The alpha of BGRA is
+ * ignored. The reference backend keeps to what the reference handles - 8-bit
+ * BGR, and 8-bit gray for focus and blur - and leaves every other format to
+ * the optimized kernels.
+ */
+bool supported(const cv::Mat &img);
+
+// rows per tile of the optimized skin, over-exposure, blur and focus
+// kernels, 0 (the default) to process the region at once. Their working
+// memory is then bounded by a tile plus the rows the filters look past it.
+// Results equal the untiled ones, only focus may differ in the last bits as
+// its sum is rounded per tile.
+void setTileRows(int rows);
+int tileRows();
+
+// fraction of over-exposed pixels, -1 for an unsupported format. A gray
+// pixel counts as the BGR pixel with all three channels at its value.
+double overExposure(const cv::Mat &img);
+// mean Sobel gradient magnitude of roi, the whole image for an empty roi. A
+// gray image is equalized as a whole first.
+double focus(const cv::Mat &img, const cv::Rect &roi = cv::Rect());
+// mean difference between the distances from the image to a box blur of it
+// and from that blur to a second one, per pixel
+double blur(const cv::Mat &img);
+// fraction of skin pixels, and the center of mass of the skin pixels when
+// center is given (NaN when there are none)
+double skin(const cv::Mat &img, cv::Point2f *center = NULL);
+// worst standard deviation of a channel, and worst difference between the
+// means of two channels, over the upper corners of a BGR image
+void background(const cv::Mat &img, double &deviation, double &grayness);
+
+/*
+ * per pixel planes of one BGR image that several stages share. convert
+ * builds them in a single pass over the pixels instead of a cvtColor to
+ * gray, YCrCb and Lab each, and the skin and over-exposure of the image and
+ * of the face are then counted over them.
+ */
+struct Planes {
+    // the BGR2GRAY conversion, before equalization
+    cv::Mat gray;
+    // the cvSkinColorCrCb mask
+    cv::Mat skin;
+    // 1 where a pixel is over-exposed
+    cv::Mat overExposed;
+};
+
+enum PlaneFlags {
+    GRAY_PLANE = 1,
+    SKIN_PLANE = 2,
+    OVER_EXPOSED_PLANE = 4,
+    ALL_PLANES = 7
+};
+
+// builds the planes given by the flags, reusing the buffers of out. False
+// when the reference backend or tiling is on or img is not 8-bit BGR - the
+// planes are then left empty and the metrics have to be taken from img.
+bool convert(const cv::Mat &img, int planes, Planes &out);
+// overExposure and skin of roi (the whole image for an empty roi) from the
+// planes of the image, equal to them on img(roi)
+double overExposure(const Planes &planes, const cv::Rect &roi = cv::Rect());
+double skin(const Planes &planes, const cv::Rect &roi = cv::Rect(),
+            cv::Point2f *center = NULL);
+
+namespace Reference {
+double overExposure(const cv::Mat &img);
+double focus(const cv::Mat &img, const cv::Rect &roi = cv::Rect());
+double blur(const cv::Mat &img);
+double skin(const cv::Mat &img, cv::Point2f *center = NULL);
+void background(const cv::Mat &img, double &deviation, double &grayness);
+} // namespace Reference
+
+namespace Optimized {
+double overExposure(const cv::Mat &img);
+double focus(const cv::Mat &img, const cv::Rect &roi = cv::Rect());
+double blur(const cv::Mat &img);
+double skin(const cv::Mat &img, cv::Point2f *center = NULL);
+void background(const cv::Mat &img, double &deviation, double &grayness);
+} // namespace Optimized
+
+} // namespace FaceMetrics
+
+#endif // FACEMETRICS_H
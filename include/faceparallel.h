@@ -0,0 +1,91 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef FACEPARALLEL_H
+#define FACEPARALLEL_H
+
+#include "facescratch.h"
+#include "opencv2/core/core.hpp"
+#include <algorithm>
+#include <vector>
+
+/**
+ * Row parallel loops of the metric kernels on the OpenCV thread pool, so
+ * they take no more threads than cv::setNumThreads allows - with one thread
+ * they run on the caller. The rows are split into stripes that depend on the
+ * row count only, and the partial results of the stripes are added up in
+ * stripe order, so a result does not depend on the thread count. Every
+ * stripe gets a FaceScratch nesting level, so a stripe body may use the
+ * scratch buffers even when the backend runs stripes inside one another.
+ */
+namespace FaceParallel {
+
+// fewer rows are not worth handing to another thread
+const int minStripeRows = 64;
+const int maxStripes = 32;
+
+inline int stripeCount(int rows)
+{
+    return std::max(1, std::min(rows / minStripeRows, maxStripes));
+}
+
+template <typename F> class StripeBody : public cv::ParallelLoopBody {
+  public:
+    StripeBody(int rows, int stripes, const F &body)
+        : rows(rows), stripes(stripes), body(body)
+    {
+    }
+
+    void operator()(const cv::Range &range) const
+    {
+        for (int s = range.start; s < range.end; s++) {
+            FaceScratch::Nesting nesting;
+            body(s, (int)((long)rows * s / stripes),
+                 (int)((long)rows * (s + 1) / stripes));
+        }
+    }
+
+  private:
+    int rows;
+    int stripes;
+    const F &body;
+};
+
+// calls body(stripe, first row, end row) for every stripe of [0, rows)
+template <typename F> void forStripes(int rows, const F &body)
+{
+    int stripes = stripeCount(rows);
+    if (stripes == 1) {
+        FaceScratch::Nesting nesting;
+        body(0, 0, rows);
+        return;
+    }
+    cv::parallel_for_(cv::Range(0, stripes),
+                      StripeBody<F>(rows, stripes, body), stripes);
+}
+
+// the sum of body(first row, end row) over the stripes of [0, rows)
+template <typename T, typename F> T sumStripes(int rows, const F &body)
+{
+    std::vector<T> partials(stripeCount(rows), T());
+    forStripes(rows, [&](int stripe, int first, int last) {
+        partials[stripe] = body(first, last);
+    });
+
+    T sum = T();
+    for (size_t i = 0; i < partials.size(); i++) {
+        sum += partials[i];
+    }
+    return sum;
+}
+
+} // namespace FaceParallel
+
+#endif // FACEPARALLEL_H
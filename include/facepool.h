@@ -0,0 +1,85 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef FACEPOOL_H
+#define FACEPOOL_H
+
+#include "Face.h"
+#include "facewire.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * Multi-process evaluation without a cold start per process.
+ *
+ * start() loads the cascades of an initialized Face in the calling process
+ * and then forks the workers, so every worker shares the parent's cascades
+ * through copy-on-write pages. OpenBR starts a thread pool, which fork would
+ * not carry over, so each worker starts its own OpenBR before it reports
+ * ready. Requests go to the workers over socket pairs using the FaceWire
+ * framing. Each worker owns its copy of OpenBR's process global state, so
+ * no two evaluations ever share it.
+ *
+ * start() must be called before the process creates any other thread (and
+ * before the face has started OpenBR or evaluated anything), since only the
+ * forking thread survives in the workers. It returns false, with every
+ * worker it forked stopped and reaped, unless all of them came up. A worker
+ * that dies is replaced by a new one forked from the same Face.
+ */
+class FacePool {
+  public:
+    FacePool();
+    ~FacePool();
+
+    // forks budget.workers workers (resolved if 0), each pinned by the
+    // budget and with its OpenCV and OpenBR pools capped to its share
+    bool start(Face &face, const FaceThreads::Budget &budget);
+    void stop();
+
+    // number of workers still running
+    int size();
+
+    // thread safe - blocks until a worker is idle, returns false if no worker
+    // is left or the worker died while evaluating
+    bool evaluate(const FaceWire::Request &request,
+                  FaceWire::Response &response);
+    // evaluates every request, keeping all workers busy
+    std::vector<FaceWire::Response>
+    evaluateAll(const std::vector<FaceWire::Request> &requests);
+
+    // evaluates one request with the given face, used by the workers
+    static void evaluateRequest(Face &face, const FaceWire::Request &request,
+                                FaceWire::Response &response);
+
+  private:
+    struct Worker {
+        pid_t pid;
+        int fd;
+        bool busy;
+        bool alive;
+    };
+
+    bool forkWorker(int index, Worker &worker);
+
+    // as given to start, kept to fork replacements of workers that die
+    Face *face;
+    FaceThreads::Budget budget;
+    std::vector<Worker> workers;
+    std::mutex mutex;
+    std::condition_variable idle;
+
+    FacePool(const FacePool &);
+    FacePool &operator=(const FacePool &);
+};
+
+#endif // FACEPOOL_H
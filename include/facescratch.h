@@ -0,0 +1,69 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef FACESCRATCH_H
+#define FACESCRATCH_H
+
+#include "opencv2/core/core.hpp"
+
+/**
+ * Per-thread scratch buffers for the full frame intermediates of the metric
+ * kernels and the cascades (gray, Lab, YCrCb, blurs, gradients). A buffer
+ * grows to the largest image its thread has seen and is then reused, so
+ * once the sizes settle evaluating an image does no large allocation. Inside
+ * a stripe (see Nesting) a buffer only keeps up to 16 MB, anything larger
+ * gets a matrix of its own, so the OpenCV pool threads do not hold on to the
+ * peak of a huge image - the evaluating thread's full frame buffers do.
+ */
+namespace FaceScratch {
+
+// one buffer per intermediate, so those in use at the same time never share
+enum Slot {
+    GRAY,
+    EQUALIZED,
+    // a 16-bit stripe as float, for its Lab conversion
+    FLOAT_BGR,
+    LAB,
+    YCRCB,
+    SKIN_MASK,
+    BLUR1,
+    BLUR2,
+    SOBEL_X,
+    SOBEL_Y,
+    MAGNITUDE,
+    SLOT_COUNT
+};
+
+// a continuous rows x cols matrix of type over the buffer of slot on the
+// calling thread, contents undefined. It is only valid until the same slot is
+// asked for again on this thread at the same nesting level, so it must not
+// be kept or handed to another thread.
+cv::Mat get(Slot slot, int rows, int cols, int type);
+
+/*
+ * a nesting level of the calling thread, with buffers of its own, for as
+ * long as it is in scope. FaceParallel enters one around every stripe: a
+ * thread waiting in a parallel OpenCV call may run another stripe in the
+ * meantime (TBB steals work), and that stripe must not write over the
+ * buffers the one below it on the stack is still using.
+ */
+class Nesting {
+  public:
+    Nesting();
+    ~Nesting();
+
+  private:
+    Nesting(const Nesting &);
+    Nesting &operator=(const Nesting &);
+};
+
+} // namespace FaceScratch
+
+#endif // FACESCRATCH_H
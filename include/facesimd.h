@@ -0,0 +1,77 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef FACESIMD_H
+#define FACESIMD_H
+
+#include <cstdint>
+
+/**
+ * The row loops of the optimized metric kernels, built once per instruction
+ * set and picked at load time from what the CPU supports, so one binary
+ * runs well on AVX-512 servers and on older AVX2 and SSE4.2 hosts alike.
+ * BIQT_FACE_SIMD=scalar|sse4.2|avx2|avx512 forces a variant (if the CPU has
+ * it). Every variant gives exactly the same results.
+ */
+namespace FaceSimd {
+
+enum Level { SCALAR, SSE42, AVX2, AVX512, LEVEL_COUNT };
+
+// the best level the CPU supports
+Level detected();
+// the level in use
+Level level();
+// false (and the level unchanged) if the CPU does not support it
+bool setLevel(Level level);
+
+const char *name(Level level);
+bool parseLevel(const char *name, Level &level);
+
+// the over-exposed pixels among count interleaved 8-bit Lab pixels, see
+// FaceMetrics::Optimized::overExposure
+long overExposedPixels(const uint8_t *lab, int count);
+// the same for float Lab pixels (L from 0 to 100), tested on their 8-bit
+// encoding
+long overExposedPixels(const float *lab, int count);
+// mask[i] = table[Cr * 256 + Cb] for count interleaved YCrCb pixels
+void skinLookup(const uint8_t *ycrcb, uint8_t *mask, int count,
+                const uint8_t *table);
+// 1 for each of count interleaved Lab pixels that is over-exposed, else 0
+void overExposedMask(const uint8_t *lab, uint8_t *mask, int count);
+// the BGR2GRAY conversion and the skin table lookup of the BGR2YCrCb
+// conversion of count interleaved BGR pixels, in the fixed point arithmetic
+// of OpenCV. Either output may be NULL.
+void grayAndSkin(const uint8_t *bgr, uint8_t *gray, uint8_t *skin, int count,
+                 const uint8_t *table);
+
+/*
+ * kernels specialized for the depth and channel count of an image, looked
+ * up once per image. A 16-bit channel is measured in 8-bit units, so a
+ * 16-bit image needs no conversion to 8 bits first.
+ */
+enum Depth { DEPTH_8U, DEPTH_16U, DEPTH_COUNT };
+
+// the sum of the distance differences above threshold of count pixels, see
+// FaceMetrics::Optimized::blur. The alpha of 4 channels is left out.
+typedef int (*BlurDifference)(const void *img, const void *blur1,
+                              const void *blur2, int count, int threshold);
+// NULL unless cn is 1 to 4
+BlurDifference blurDifference(Depth depth, int cn);
+
+// mask[i] = table[Cr * 256 + Cb] for the YCrCb chroma, computed as cvtColor
+// does for 8 bits, of count interleaved gray, BGR or BGRA pixels
+typedef void (*SkinMask)(const void *pixels, uint8_t *mask, int count,
+                         const uint8_t *table);
+// NULL unless cn is 1, 3 or 4
+SkinMask skinMask(Depth depth, int cn);
+
+} // namespace FaceSimd
+
+#endif // FACESIMD_H
@@ -0,0 +1,70 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef FACETHREADS_H
+#define FACETHREADS_H
+
+#include <string>
+#include <vector>
+
+/**
+ * The threads an evaluation may use. OpenCV, OpenBR (through its Qt thread
+ * pool) and the workers of the caller each start threads of their own, so
+ * left alone N workers end up with N times as many threads as there are
+ * CPUs. A Budget splits the CPUs the process may actually use - its affinity
+ * mask, capped by the CPU quota of its cgroup - among the workers, and each
+ * worker's share caps the OpenCV and OpenBR pools. See Face::setThreadBudget.
+ */
+namespace FaceThreads {
+
+enum Pinning {
+    NO_PINNING,
+    // each worker to one CPU of the affinity mask, round robin
+    PIN_CORES,
+    // each worker to the CPUs of one NUMA node, round robin
+    PIN_NUMA_NODES
+};
+
+struct Budget {
+    // the outer workers, 0 - one per available CPU, or the available CPUs
+    // shared out by the threads per worker when that is set
+    int workers;
+    // the OpenCV and OpenBR threads of a worker, 0 - the available CPUs
+    // shared out by the workers when those are set, else the pools' own
+    // defaults
+    int threadsPerWorker;
+    Pinning pinning;
+
+    Budget() : workers(0), threadsPerWorker(0), pinning(NO_PINNING) {}
+};
+
+// the CPUs in the affinity mask of the calling thread
+std::vector<int> allowedCpus();
+// the CPUs the process can keep busy: the affinity mask, capped by a cgroup
+// v2 cpu.max or v1 cfs quota rounded up. At least 1.
+int availableCpus();
+
+// fills in the workers of budget, and the threads per worker of a budget
+// that sets only the workers, from availableCpus
+Budget resolve(const Budget &budget);
+// caps the OpenCV pool at the threads per worker if set, see also
+// BrLandmarker
+void apply(const Budget &resolved);
+
+// restricts the calling thread to the CPU or NUMA node of the worker with
+// the given index. False (and nothing changed) if that cannot be done.
+bool pinWorker(Pinning pinning, int index);
+
+// "none", "cores" or "numa", false for anything else
+bool parsePinning(const std::string &name, Pinning &pinning);
+
+} // namespace FaceThreads
+
+#endif // FACETHREADS_H
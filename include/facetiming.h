@@ -0,0 +1,129 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef FACETIMING_H
+#define FACETIMING_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Per-stage latency counters for the evaluation pipeline. Each stage is
+ * timed with a monotonic wall clock and the CPU time of the calling thread.
+ * Samples go to per-thread counters and log2 histograms, so timing a stage
+ * takes no lock. Off by default - a disabled Timer costs one flag check.
+ */
+namespace FaceTiming {
+
+enum Stage {
+    // decode
+    IMREAD,
+    IMDECODE,
+    // cvtColor and equalizeHist before the cascades run
+    GRAY,
+    // the fused gray, skin and over-exposure planes of FULL mode
+    CONVERT_PLANES,
+    // detectMultiScale, in the order of CvLandmarker::Cascade
+    DETECT_HAAR_FACE,
+    DETECT_HAAR_PROFILE_FACE,
+    DETECT_LBP_FACE,
+    DETECT_EYE_PAIR,
+    DETECT_LEFT_EYE,
+    DETECT_RIGHT_EYE,
+    DETECT_NOSE,
+    DETECT_MOUTH,
+    // OpenBR
+    REGISTER_IMAGE,
+    // the metric setters of Face (the image size setters are too cheap to
+    // be worth timing)
+    SET_FACE,
+    SET_SAP_LEVEL,
+    SET_CV_NUM_LANDMARKS,
+    SET_EYE_COUNT,
+    SET_NOSE_COUNT,
+    SET_MOUTH_COUNT,
+    SET_OPENBR_METRICS,
+    SET_SKIN_FULL,
+    SET_FACE_OFFSET,
+    SET_FOCUS,
+    SET_OVER_EXPOSURE,
+    SET_BLUR,
+    SET_BACKGROUND,
+    STAGE_COUNT
+};
+
+// bucket i holds the samples from 2^i to 2^(i+1) microseconds
+const int HISTOGRAM_BUCKETS = 32;
+
+struct StageStats {
+    uint64_t count;
+    double wallSeconds;
+    double cpuSeconds;
+    double maxWallSeconds;
+    uint64_t histogram[HISTOGRAM_BUCKETS];
+
+    // upper bound of the wall time below which the given fraction (0-1) of
+    // the samples fall, 0 without samples
+    double wallPercentile(double fraction) const;
+};
+
+// e.g. "setBlur" or "detectMultiScale:left eye"
+const char *stageName(Stage stage);
+// the detection stage of a CvLandmarker::Cascade
+Stage cascadeStage(int cascade);
+
+void setEnabled(bool enabled);
+bool isEnabled();
+
+// totals over every thread, indexed by Stage
+void snapshot(std::vector<StageStats> &stats);
+// only meant to be called while nothing is being timed
+void reset();
+
+/*
+ * per image timing - the wall seconds of each stage run for the image of the
+ * calling thread since beginImage, keyed by stage name. beginImage starts a
+ * new image on the calling thread; helper threads working on it add theirs
+ * once given it with setCurrentImage.
+ */
+void beginImage();
+void imageTimes(std::map<std::string, double> &times);
+
+// the per image times, shared by every thread working on the image
+struct ImageTimes;
+typedef std::shared_ptr<ImageTimes> ImageContext;
+// the image of the calling thread (empty for none), so helper threads can add
+// their stages to the image they work on
+ImageContext currentImage();
+void setCurrentImage(const ImageContext &image);
+
+// times its scope, and adds it to the FaceTrace trace when one is running
+class Timer {
+  public:
+    explicit Timer(Stage stage);
+    ~Timer();
+
+  private:
+    Stage stage;
+    bool running;
+    bool tracing;
+    uint64_t wallStart;
+    uint64_t cpuStart;
+
+    Timer(const Timer &);
+    Timer &operator=(const Timer &);
+};
+
+} // namespace FaceTiming
+
+#endif // FACETIMING_H
@@ -0,0 +1,64 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef FACETRACE_H
+#define FACETRACE_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Opt-in trace of a run in the Chrome trace event format, for
+ * chrome://tracing or ui.perfetto.dev. Every FaceTiming stage becomes a span
+ * on the thread that ran it, inside a span per image, and carries the
+ * identifier of that image.
+ *
+ * Spans go to a buffer per thread and are only gathered and written out by
+ * stop(), so tracing adds a short uncontended lock and an append per stage.
+ * A trace keeps at most about a million spans and images; stop() reports
+ * how many more were dropped.
+ */
+namespace FaceTrace {
+
+// starts collecting, the trace is written to path by stop(). False if a trace
+// is already running.
+bool start(const std::string &path);
+// writes the trace out and stops collecting, false if it could not be written
+bool stop();
+bool isEnabled();
+
+// a span for one image - stages run on this thread in its scope are tagged
+// with the image
+class ImageSpan {
+  public:
+    explicit ImageSpan(const std::string &image);
+    ~ImageSpan();
+
+  private:
+    uint32_t image;
+    uint32_t previous;
+    uint64_t start;
+
+    ImageSpan(const ImageSpan &);
+    ImageSpan &operator=(const ImageSpan &);
+};
+
+// the image of the calling thread (0 for none), so helper threads can tag
+// their spans with the image they work on
+uint32_t currentImage();
+void setCurrentImage(uint32_t image);
+
+// adds a finished span on the calling thread, times from steady_clock. The
+// part of a span before start() is left out.
+void record(const char *name, uint64_t startNs, uint64_t durationNs);
+
+} // namespace FaceTrace
+
+#endif // FACETRACE_H
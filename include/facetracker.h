@@ -0,0 +1,44 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef FACETRACKER_H
+#define FACETRACKER_H
+
+#include "opencv2/core/core.hpp"
+
+/**
+ * Follows a detected face rectangle from frame to frame by normalized
+ * template matching in a window around its last position. Frames are
+ * matched at a reduced scale, so the cost does not depend on the frame size.
+ */
+class FaceTracker {
+  public:
+    FaceTracker();
+
+    // starts tracking rect in the given grayscale frame
+    void init(const cv::Mat &gray, const cv::Rect &rect);
+    void reset();
+    bool isTracking() const;
+
+    // moves rect to the best match in the next grayscale frame and returns
+    // the match confidence (normalized correlation, 1 is a perfect match).
+    // Returns -1 and stops tracking if the face left the frame.
+    double update(const cv::Mat &gray, cv::Rect &rect);
+
+  private:
+    cv::Mat scaled(const cv::Mat &gray, const cv::Rect &region) const;
+
+    bool tracking;
+    double scale; // applied to the frame before matching
+    cv::Rect lastRect;
+    cv::Mat faceTemplate;
+};
+
+#endif // FACETRACKER_H
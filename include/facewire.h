@@ -0,0 +1,85 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef FACEWIRE_H
+#define FACEWIRE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+/**
+ * Framing for evaluate requests sent between processes on the same host
+ * (FacePool workers and the FaceDaemon). Values are written in host byte
+ * order.
+ *
+ * @verbatim
+ *  request:  uint32 kind, uint32 mode, uint64 payload length, payload
+ *  response: int32 status, double quality, uint32 metric count,
+ *            metrics: uint32 name length, name, double value
+ * @endverbatim
+ */
+namespace FaceWire {
+
+enum RequestKind {
+    PATH = 1,         // payload is an image path readable by the worker
+    ENCODED = 2,      // payload is an encoded image (jpeg, png, ...)
+    SHARED_MEMORY = 3 // payload is a SharedImage header and a shm name
+};
+
+// decoded pixels left by the caller in a POSIX shared memory object
+struct SharedImage {
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t type; // OpenCV type, e.g. CV_8UC3
+    uint32_t reserved;
+    uint64_t step; // bytes per row
+    uint64_t offset; // of the first pixel in the object
+};
+
+enum Status {
+    OK = 0,
+    DECODE_ERROR = 1, // getQuality returned -1
+    FAILED = 2,       // the request could not be evaluated
+    BAD_REQUEST = 3,
+    BUSY = 4 // turned away by admission control, retry later
+};
+
+struct Request {
+    uint32_t kind;
+    uint32_t mode; // Face::FaceMode
+    std::string payload;
+};
+
+struct Response {
+    int32_t status;
+    double quality;
+    std::map<std::string, double> metrics;
+};
+
+// both retry on EINTR and return false on EOF or error
+bool writeAll(int fd, const void *data, size_t size);
+bool readAll(int fd, void *data, size_t size);
+
+// payload helpers for SHARED_MEMORY requests
+std::string encodeSharedImage(const SharedImage &image,
+                              const std::string &shmName);
+bool decodeSharedImage(const std::string &payload, SharedImage &image,
+                       std::string &shmName);
+
+bool writeRequest(int fd, const Request &request);
+bool readRequest(int fd, Request &request);
+bool writeResponse(int fd, const Response &response);
+bool readResponse(int fd, Response &response);
+
+} // namespace FaceWire
+
+#endif // FACEWIRE_H
@@ -8,12 +8,16 @@
 // Copyright 2019 The MITRE Corporation. All Rights Reserved.
 // #######################################################################
 
+#include <algorithm>
+#include <cctype>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <string>
 
 #include "BIQTFace.h"
+#include "facemetrics.h"
+#include "facetrace.h"
 
 /**
  *  Creates a BIQTFace instance
@@ -26,41 +30,78 @@ BIQTFace::BIQTFace()
                             std::ifstream::binary);
     desc_file >> DescriptorObject;
 
-    // Initialize module
-    face.initialize("");
+    // before the models load, so their warm-up is timed too
+    if (getenv("BIQT_FACE_TIMING") != NULL) {
+        FaceTiming::setEnabled(true);
+    }
+
+    // Initialize module - with BIQT_FACE_ASYNC_INIT set the models load in the
+    // background while the first image is being read
+    if (getenv("BIQT_FACE_ASYNC_INIT") != NULL) {
+        face.initializeAsync("");
+    }
+    else {
+        face.initialize("");
+    }
+
+    face.setSkinGuidedDetection(getenv("BIQT_FACE_SKIN_ROI") != NULL);
+    face.setSpeculativeProfileDetection(
+        getenv("BIQT_FACE_SPECULATIVE_PROFILE") != NULL);
+    face.setAnyDepth(getenv("BIQT_FACE_ANY_DEPTH") != NULL);
+    if (getenv("BIQT_FACE_REFERENCE_KERNELS") != NULL) {
+        FaceMetrics::setBackend(FaceMetrics::REFERENCE);
+    }
+    if (getenv("BIQT_FACE_TILE_ROWS") != NULL) {
+        FaceMetrics::setTileRows(atoi(getenv("BIQT_FACE_TILE_ROWS")));
+    }
+
+    FaceThreads::Budget budget;
+    const char *workers = getenv("BIQT_FACE_WORKERS");
+    const char *threads = getenv("BIQT_FACE_THREADS_PER_WORKER");
+    const char *pinning = getenv("BIQT_FACE_PINNING");
+    if (workers != NULL) {
+        budget.workers = atoi(workers);
+    }
+    if (threads != NULL) {
+        budget.threadsPerWorker = atoi(threads);
+    }
+    if (pinning != NULL &&
+        !FaceThreads::parsePinning(pinning, budget.pinning)) {
+        std::cerr << "Ignoring BIQT_FACE_PINNING=" << pinning
+                  << ", expected none, cores or numa" << std::endl;
+    }
+    if (workers != NULL || threads != NULL || pinning != NULL) {
+        face.setThreadBudget(budget);
+    }
+    // written out when the provider is destroyed
+    if (getenv("BIQT_FACE_TRACE") != NULL) {
+        FaceTrace::start(getenv("BIQT_FACE_TRACE"));
+    }
 }
 
 /**
  * The destructor.
  */
-BIQTFace::~BIQTFace() { face.finalize(); }
+BIQTFace::~BIQTFace()
+{
+    face.finalize();
+    if (FaceTrace::isEnabled()) {
+        FaceTrace::stop();
+    }
+}
 
 /**
- * Evaluates the face images.
+ * Converts the metrics of one evaluated image or frame to a quality result.
  *
- * @param file the input file.
+ * @param quality the overall quality.
+ * @param module_result the metrics from Face::getQuality.
  *
- * @return The result of the evaluation.
+ * @return The quality result.
  */
-Provider::EvaluationResult BIQTFace::evaluate(const std::string &file)
+static Provider::QualityResult
+toQualityResult(double quality, std::map<std::string, double> &module_result)
 {
-    // Initialize some variables
-    Face::FaceMode mode = Face::FULL;
-    Provider::EvaluationResult eval_result;
     Provider::QualityResult quality_result;
-
-    // Read input file
-    std::map<std::string, double> module_result;
-    double quality = face.getQuality(file, module_result, mode);
-
-    // If there was an error reading the image
-    if (quality == -1) {
-        eval_result.errorCode = 1;
-        return eval_result;
-    }
-
-    // Construct evaluation result
-    eval_result.errorCode = 0;
     quality_result.metrics["quality"] = quality;
     
     quality_result.metrics["background_deviation"] = module_result["BGDeviation"];
@@ -135,7 +176,136 @@ Provider::EvaluationResult BIQTFace::evaluate(const std::string &file)
     quality_result.features["openbr_right_eye_x"] = module_result["BrRightEyePosition_X"];
     quality_result.features["openbr_right_eye_y"] = module_result["BrRightEyePosition_Y"];
     
-    eval_result.qualityResult.push_back(std::move(quality_result));
+    return quality_result;
+}
+
+/**
+ * Checks whether a file should be read as a video rather than an image.
+ *
+ * @param file the input file.
+ *
+ * @return true if the extension is a known video container.
+ */
+static bool isVideo(const std::string &file)
+{
+    static const char *extensions[] = {".avi", ".mp4", ".mov", ".mkv", ".m4v",
+                                       ".mpg", ".mpeg", ".wmv", ".webm"};
+
+    size_t dot = file.rfind('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    std::string extension = file.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   ::tolower);
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++) {
+        if (extension == extensions[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Evaluates the face images. With BIQT_FACE_TIMING set every quality result
+ * also gets the time spent in each stage as timing_<stage> features. With
+ * BIQT_FACE_TRACE set the stages are traced under a span for the file.
+ *
+ * @param file the input file.
+ *
+ * @return The result of the evaluation.
+ */
+Provider::EvaluationResult BIQTFace::evaluate(const std::string &file)
+{
+    FaceTrace::ImageSpan span(file);
+    if (!FaceTiming::isEnabled()) {
+        return evaluateFile(file);
+    }
+
+    FaceTiming::beginImage();
+    Provider::EvaluationResult eval_result = evaluateFile(file);
+    std::map<std::string, double> times;
+    FaceTiming::imageTimes(times);
+
+    for (size_t i = 0; i < eval_result.qualityResult.size(); i++) {
+        std::map<std::string, double>::const_iterator it;
+        for (it = times.begin(); it != times.end(); ++it) {
+            // "detectMultiScale:left eye" - timing_detectMultiScale_left_eye
+            std::string name = "timing_" + it->first;
+            std::replace_if(name.begin(), name.end(),
+                            [](char c) { return !isalnum((unsigned char)c); },
+                            '_');
+            eval_result.qualityResult[i].features[name] = it->second;
+        }
+    }
+    return eval_result;
+}
+
+/**
+ * Evaluates one file. A video file yields one quality result per frame, with
+ * the face tracked between keyframes.
+ *
+ * @param file the input file.
+ *
+ * @return The result of the evaluation.
+ */
+Provider::EvaluationResult BIQTFace::evaluateFile(const std::string &file)
+{
+    // Initialize some variables
+    Face::FaceMode mode = Face::FULL;
+    Provider::EvaluationResult eval_result;
+
+    if (isVideo(file)) {
+        std::vector<std::map<std::string, double>> frames;
+        if (face.getSequenceQuality(file, frames, mode) <= 0) {
+            eval_result.errorCode = 1;
+            return eval_result;
+        }
+
+        eval_result.errorCode = 0;
+        for (size_t i = 0; i < frames.size(); i++) {
+            Provider::QualityResult quality_result =
+                toQualityResult(frames[i]["Quality"], frames[i]);
+            quality_result.features["frame_index"] = frames[i]["FrameIndex"];
+            quality_result.features["frame_tracked"] = frames[i]["Tracked"];
+            eval_result.qualityResult.push_back(std::move(quality_result));
+        }
+        return eval_result;
+    }
+
+    // with BIQT_FACE_MULTI_FACE set every face gets its own result
+    if (getenv("BIQT_FACE_MULTI_FACE") != NULL) {
+        std::vector<std::map<std::string, double>> faces;
+        if (face.getMultiFaceQuality(file, faces, mode) == -1) {
+            eval_result.errorCode = 1;
+            return eval_result;
+        }
+
+        eval_result.errorCode = 0;
+        for (size_t i = 0; i < faces.size(); i++) {
+            Provider::QualityResult quality_result =
+                toQualityResult(faces[i]["Quality"], faces[i]);
+            quality_result.features["face_index"] = faces[i]["FaceIndex"];
+            quality_result.features["face_count"] = faces[i]["FaceCount"];
+            eval_result.qualityResult.push_back(std::move(quality_result));
+        }
+        return eval_result;
+    }
+
+    // Read input file
+    std::map<std::string, double> module_result;
+    double quality = face.getQuality(file, module_result, mode);
+
+    // If there was an error reading the image
+    if (quality == -1) {
+        eval_result.errorCode = 1;
+        return eval_result;
+    }
+
+    // Construct evaluation result
+    eval_result.errorCode = 0;
+    eval_result.qualityResult.push_back(
+        toQualityResult(quality, module_result));
 
     return eval_result;
 }
@@ -9,17 +9,261 @@
 // #######################################################################
 
 #include "Face.h"
-#include "cvskincolorcbcr.h"
+#include "facemetrics.h"
+#include "facetrace.h"
 #include "opencv2/core/core.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/objdetect/objdetect.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
+
+// coefficients were found using the InfoGainAtributeEval Ranker method after
+// normalizing the parameters  BrConfidence has already been normalized from 0
+// to 1 and CvEyeCount will be divided by two to meet this 0-1 requirement!
+static const double mouthWeight = 0.743;
+static const double eyesWeight = 0.706;
+static const double skinWeight = 0.691;
+static const double frontalWeight = 0.675;
+static const double noseWeight = 0.606;
+static const double brConfidenceWeight = 0.513;
+// getting the max for normalization from 0 to 1
+static const double overallQualityMax = mouthWeight * 1 + eyesWeight * 1 +
+                                        skinWeight * 1.0 + frontalWeight * 1 +
+                                        noseWeight * 1 + brConfidenceWeight * 1;
+
+// the stages of getQualityBefore, in the order they run. The quality formula
+// inputs come first, the quality metrics that are not part of it follow -
+// cheapest first since they are all worth the same to the score.
+enum DeadlineStage {
+    DETECTION_STAGE,
+    LANDMARK_STAGE,
+    SKIN_STAGE,
+    OPENBR_STAGE,
+    BACKGROUND_STAGE,
+    FOCUS_STAGE,
+    OVER_EXPOSURE_STAGE,
+    BLUR_STAGE,
+    DEADLINE_STAGE_COUNT
+};
+
+// the metrics each stage sets, marked as not computed when it is skipped
+static const char *detectionKeys[] = {
+    "CvFaceFound", "CvFrontalFaceFound", "CvProfileFaceFound", "CvFaceX",
+    "CvFaceY",     "CvFaceWidth",        "CvFaceHeight",       "SAPLevel",
+    "SAPFailureCode", NULL};
+static const char *landmarkKeys[] = {
+    "CvNumLandmarks",       "CvEyeCount",           "CvRightEyePosition_X",
+    "CvRightEyePosition_Y", "CvLeftEyePosition_X",  "CvLeftEyePosition_Y",
+    "CvIPD",                "CvNoseCount",          "CvNosePosition_X",
+    "CvNosePosition_Y",     "CvMouthCount",         "CvMouthPosition_X",
+    "CvMouthPosition_Y",    NULL};
+static const char *skinKeys[] = {"SkinFace",          "SkinFull",
+                                 "FaceCenterOfMassX", "FaceCenterOfMassY",
+                                 "FaceOffsetX",       "FaceOffsetY",
+                                 NULL};
+static const char *openBrKeys[] = {
+    "BrConfidence",        "BrRightEyePosition_X", "BrRightEyePosition_Y",
+    "BrLeftEyePosition_X", "BrLeftEyePosition_Y",  "BrIPD",
+    NULL};
+static const char *backgroundKeys[] = {"BGDeviation", "BGGrayness", NULL};
+static const char *focusKeys[] = {"Focus", "FocusFace", NULL};
+static const char *overExposureKeys[] = {"OverExposure", "OverExposureFace",
+                                         NULL};
+static const char *blurKeys[] = {"Blur", "BlurFace", NULL};
+
+static const char **deadlineStageKeys[DEADLINE_STAGE_COUNT] = {
+    detectionKeys,  landmarkKeys, skinKeys,         openBrKeys,
+    backgroundKeys, focusKeys,    overExposureKeys, blurKeys};
+
+// the modes a metric is reported in
+enum ModeMask {
+    IN_FULL = 1 << Face::FULL,
+    IN_SHORT = 1 << Face::SHORT,
+    IN_LANDMARK = 1 << Face::LANDMARK,
+    // the modes that compute the quality score
+    IN_SCORED = IN_FULL | IN_SHORT,
+    IN_ALL = IN_SCORED | IN_LANDMARK
+};
+
+struct ModeMetric {
+    const char *name;
+    // before evaluation
+    double initial;
+    int modes;
+};
+
+// every metric prepMetricsWriteMapByMode sets and the modes reporting it
+static const ModeMetric modeMetrics[] = {
+    {"ImageWidth", -1, IN_ALL},
+    {"ImageHeight", -1, IN_ALL},
+    {"ImageChannels", -1, IN_FULL},
+    {"ImageArea", -1, IN_FULL},
+    {"ImageRatio", -1, IN_FULL},
+    {"CvFrontalFaceFound", 0, IN_ALL},
+    {"CvProfileFaceFound", 0, IN_ALL},
+    {"CvFaceX", -1, IN_ALL},
+    {"CvFaceY", -1, IN_ALL},
+    {"CvFaceWidth", -1, IN_ALL},
+    {"CvFaceHeight", -1, IN_ALL},
+    {"SAPLevel", 0, IN_FULL},
+    {"SAPFailureCode", Face::NO_FAILURE, IN_FULL},
+    {"CvNumLandmarks", 0, IN_FULL},
+    {"CvEyeCount", 0, IN_SCORED},
+    {"CvRightEyePosition_X", -1, IN_ALL},
+    {"CvRightEyePosition_Y", -1, IN_ALL},
+    {"CvLeftEyePosition_X", -1, IN_ALL},
+    {"CvLeftEyePosition_Y", -1, IN_ALL},
+    {"CvIPD", -1, IN_SCORED},
+    {"CvNoseCount", 0, IN_SCORED},
+    {"CvNosePosition_X", -1, IN_ALL},
+    {"CvNosePosition_Y", -1, IN_ALL},
+    {"CvMouthCount", 0, IN_SCORED},
+    {"CvMouthPosition_X", -1, IN_ALL},
+    {"CvMouthPosition_Y", -1, IN_ALL},
+    {"BrRightEyePosition_X", -1, IN_ALL},
+    {"BrRightEyePosition_Y", -1, IN_ALL},
+    {"BrLeftEyePosition_X", -1, IN_ALL},
+    {"BrLeftEyePosition_Y", -1, IN_ALL},
+    {"BrIPD", 0, IN_SCORED},
+    {"FaceCenterOfMassX", -1, IN_FULL},
+    {"FaceCenterOfMassY", -1, IN_FULL},
+    {"FaceOffsetX", -1, IN_FULL},
+    {"FaceOffsetY", -1, IN_FULL},
+    {"SkinFull", 0, IN_FULL},
+    {"SkinFace", 0, IN_SCORED},
+    {"Focus", 0, IN_FULL},
+    {"FocusFace", 0, IN_FULL},
+    {"OverExposure", 0, IN_FULL},
+    {"OverExposureFace", 0, IN_FULL},
+    {"Blur", 0, IN_FULL},
+    {"BlurFace", 0, IN_FULL},
+    {"BGDeviation", 0, IN_FULL},
+    {"BGGrayness", 0, IN_FULL}};
+
+typedef std::vector<std::pair<std::string, double>> MetricList;
+
+static MetricList selectMetrics(int mask)
+{
+    MetricList list;
+    for (size_t i = 0; i < sizeof(modeMetrics) / sizeof(modeMetrics[0]);
+         i++) {
+        if (modeMetrics[i].modes & mask) {
+            list.push_back(
+                std::make_pair(modeMetrics[i].name, modeMetrics[i].initial));
+        }
+    }
+    return list;
+}
+
+// the metrics of mode M with their initial values, selected once
+template <Face::FaceMode M> static const MetricList &modeMetricList()
+{
+    static const MetricList list = selectMetrics(1 << M);
+    return list;
+}
+
+static void prepMetrics(const MetricList &list,
+                        std::map<std::string, double> &metrics)
+{
+    for (size_t i = 0; i < list.size(); i++) {
+        metrics[list[i].first] = list[i].second;
+    }
+}
 
-Face::Face() {}
-Face::~Face() {}
+// whether mode M reports key - its metrics, whether a face was found and the
+// score input BrConfidence
+template <Face::FaceMode M> static bool reportsMetric(const char *key)
+{
+    static const std::set<std::string> keys = [] {
+        const MetricList &list = modeMetricList<M>();
+        std::set<std::string> reported;
+        for (size_t i = 0; i < list.size(); i++) {
+            reported.insert(list[i].first);
+        }
+        reported.insert("CvFaceFound");
+        if (M != Face::LANDMARK) {
+            reported.insert("BrConfidence");
+        }
+        return reported;
+    }();
+    return keys.count(key) > 0;
+}
+
+/*
+ * a face found by detection alone, before any landmarking
+ */
+static CvLandmarker::LandmarkFace detectedFace(const cv::Rect &faceRect,
+                                               bool isProfile)
+{
+    CvLandmarker::LandmarkFace landmarkFace;
+    landmarkFace.containsLandmarks = false;
+    landmarkFace.isProfile = isProfile;
+    landmarkFace.numLandmarks = 0;
+    landmarkFace.faceRect = faceRect;
+    landmarkFace.rightEye = cv::Point(-1, -1);
+    landmarkFace.leftEye = cv::Point(-1, -1);
+    landmarkFace.noseTip = cv::Point(-1, -1);
+    landmarkFace.mouth = cv::Point(-1, -1);
+    return landmarkFace;
+}
+
+Face::Face()
+    : stopLoader(false),
+      threadBudget(FaceThreads::resolve(FaceThreads::Budget())),
+      anyDepth(false)
+{
+}
+
+Face::~Face()
+{
+    // the loader finalizes OpenBR before the landmarkers go away
+    if (loader.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            stopLoader = true;
+        }
+        loaderWake.notify_all();
+        loader.join();
+    }
+}
+
+void Face::setThreadBudget(const FaceThreads::Budget &budget)
+{
+    threadBudget = FaceThreads::resolve(budget);
+    // only the caps asked for, the pools keep their defaults otherwise
+    if (threadBudget.threadsPerWorker > 0) {
+        FaceThreads::apply(threadBudget);
+        BrLandmarker::setMaxThreads(threadBudget.threadsPerWorker);
+    }
+}
+
+FaceThreads::Budget Face::getThreadBudget() const { return threadBudget; }
+
+bool Face::hasPlanes(const cv::Mat &img) const
+{
+    return !planesImage.empty() && img.data == planesImage.data &&
+           img.size() == planesImage.size() && img.step == planesImage.step;
+}
+
+template <Face::FaceMode M> void Face::convertPlanes(const cv::Mat &img)
+{
+    FaceTiming::Timer timer(FaceTiming::CONVERT_PLANES);
+    planesImage.release();
+    if (M == FULL &&
+        FaceMetrics::convert(img, FaceMetrics::ALL_PLANES, planes)) {
+        planesImage = img;
+    }
+}
 
 void Face::setMetricsWriteMap(std::string name, int index)
 {
@@ -100,6 +344,90 @@ bool Face::initialize(const std::string biqtPath)
     return true;
 }
 
+/*
+ * every mode runs the same cascades and OpenBR on a frontal face - the profile
+ * cascade is included since it is needed whenever no frontal face is found
+ */
+bool Face::warmUp()
+{
+    bool loaded = cvLandmarker.warmUp(true);
+    brLandmarker.warmUp();
+    return loaded;
+}
+
+bool Face::warmUpCascades() { return cvLandmarker.warmUp(true); }
+
+void Face::startOpenBr()
+{
+    if (loader.joinable()) {
+        ready.wait();
+    }
+    else {
+        brLandmarker.warmUp();
+    }
+}
+
+std::shared_future<bool> Face::initializeAsync(const std::string biqtPath,
+                                               std::function<void(bool)> onReady)
+{
+    if (!initialize(biqtPath)) {
+        std::promise<bool> failed;
+        failed.set_value(false);
+        ready = failed.get_future().share();
+        if (onReady) {
+            onReady(false);
+        }
+        return ready;
+    }
+
+    std::shared_ptr<std::promise<bool>> loaded =
+        std::make_shared<std::promise<bool>>();
+    ready = loaded->get_future().share();
+    loader = std::thread([this, onReady, loaded]() {
+        bool ok = false;
+        try {
+            brLandmarker.warmUp();
+            ok = cvLandmarker.warmUp(true);
+            if (onReady) {
+                onReady(ok);
+            }
+            loaded->set_value(ok);
+        }
+        catch (...) {
+            loaded->set_exception(std::current_exception());
+        }
+
+        // Qt wants its application finalized on the thread that created it
+        std::unique_lock<std::mutex> lock(loaderMutex);
+        loaderWake.wait(lock, [this]() { return stopLoader; });
+        brLandmarker.release();
+    });
+    return ready;
+}
+
+bool Face::isReady() const
+{
+    return !ready.valid() ||
+           ready.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void Face::setSkinGuidedDetection(bool enabled)
+{
+    cvLandmarker.setSkinGuidedDetection(enabled);
+}
+
+void Face::setSpeculativeProfileDetection(bool enabled)
+{
+    cvLandmarker.setSpeculativeProfileDetection(enabled);
+}
+
+void Face::setAnyDepth(bool enabled) { anyDepth = enabled; }
+
+int Face::readFlags() const
+{
+    return anyDepth ? cv::IMREAD_COLOR | cv::IMREAD_ANYDEPTH : cv::IMREAD_COLOR;
+}
+
 void Face::finalize()
 {
     // finalize happens in the destructors of the landmarkers being referenced
@@ -146,12 +474,26 @@ void Face::setRatio(const cv::Mat &img, std::map<std::string, double> &metrics)
     metrics["ImageRatio"] = (double)img.cols / (double)img.rows;
 }
 
+template <Face::FaceMode M>
+void Face::setImageMetrics(const cv::Mat &img,
+                           std::map<std::string, double> &metrics)
+{
+    setWidth(img, metrics);
+    setHeight(img, metrics);
+    if (M == FULL) {
+        setChannels(img, metrics);
+        setArea(img, metrics);
+        setRatio(img, metrics);
+    }
+}
+
 /*
  *Face Metrics
  */
 void Face::setFace(const cv::Mat &img, std::map<std::string, double> &metrics,
                    const std::vector<CvLandmarker::LandmarkFace> &landmarkFaces)
 {
+    FaceTiming::Timer timer(FaceTiming::SET_FACE);
     // there won't be more than one face found - the cvlandmarker finds the
     // largest face
     if (landmarkFaces.size() > 0) {
@@ -183,24 +525,28 @@ void Face::setFace(const cv::Mat &img, std::map<std::string, double> &metrics,
     }
 }
 
+template <Face::FaceMode M>
 void Face::setCvNumLandmarks(std::map<std::string, double> &metrics,
                              const CvLandmarker::LandmarkFace &landmarkFace)
 {
-    if (biqtMode == FULL) {
+    FaceTiming::Timer timer(FaceTiming::SET_CV_NUM_LANDMARKS);
+    if (M == FULL) {
         int numLandmarks = landmarkFace.numLandmarks;
         metrics["CvNumLandmarks"] = numLandmarks;
     }
 }
 
+template <Face::FaceMode M>
 void Face::setEyeCount(const cv::Mat &img,
                        std::map<std::string, double> &metrics,
                        const CvLandmarker::LandmarkFace &landmarkFace)
 {
+    FaceTiming::Timer timer(FaceTiming::SET_EYE_COUNT);
     if (metrics["CvFrontalFaceFound"] <= 0) {
         return;
     }
 
-    if (biqtMode != LANDMARK) {
+    if (M != LANDMARK) {
         if (landmarkFace.leftEye.x > -1 && landmarkFace.leftEye.y > -1) {
             metrics["CvEyeCount"]++;
         }
@@ -218,7 +564,7 @@ void Face::setEyeCount(const cv::Mat &img,
     metrics["CvLeftEyePosition_Y"] = landmarkFace.leftEye.y;
 
     // if we have two eyes we can get the distance between them
-    if (biqtMode != LANDMARK && metrics["CvEyeCount"] == 2) {
+    if (M != LANDMARK && metrics["CvEyeCount"] == 2) {
         // if we have two eyes we can get the distance
         metrics["CvIPD"] = calculateDistance(
             metrics["CvRightEyePosition_X"], metrics["CvRightEyePosition_Y"],
@@ -226,10 +572,12 @@ void Face::setEyeCount(const cv::Mat &img,
     }
 }
 
+template <Face::FaceMode M>
 void Face::setNoseCount(const cv::Mat &img,
                         std::map<std::string, double> &metrics,
                         const CvLandmarker::LandmarkFace &landmarkFace)
 {
+    FaceTiming::Timer timer(FaceTiming::SET_NOSE_COUNT);
     if (metrics["CvFrontalFaceFound"] <= 0) {
         return;
     }
@@ -238,7 +586,7 @@ void Face::setNoseCount(const cv::Mat &img,
     metrics["CvNosePosition_X"] = landmarkFace.noseTip.x;
     metrics["CvNosePosition_Y"] = landmarkFace.noseTip.y;
 
-    if (biqtMode != LANDMARK) {
+    if (M != LANDMARK) {
         if (metrics["CvNosePosition_X"] > -1 &&
             metrics["CvNosePosition_Y"] > -1) {
             metrics["CvNoseCount"]++;
@@ -246,10 +594,12 @@ void Face::setNoseCount(const cv::Mat &img,
     }
 }
 
+template <Face::FaceMode M>
 void Face::setMouthCount(const cv::Mat &img,
                          std::map<std::string, double> &metrics,
                          const CvLandmarker::LandmarkFace &landmarkFace)
 {
+    FaceTiming::Timer timer(FaceTiming::SET_MOUTH_COUNT);
     if (metrics["CvFrontalFaceFound"] <= 0) {
         return;
     }
@@ -258,7 +608,7 @@ void Face::setMouthCount(const cv::Mat &img,
     metrics["CvMouthPosition_X"] = landmarkFace.mouth.x;
     metrics["CvMouthPosition_Y"] = landmarkFace.mouth.y;
 
-    if (biqtMode != LANDMARK) {
+    if (M != LANDMARK) {
         if (metrics["CvMouthPosition_X"] > -1 &&
             metrics["CvMouthPosition_Y"] > -1) {
             metrics["CvMouthCount"]++;
@@ -283,59 +633,31 @@ void Face::setOverExposure(const cv::Mat &img,
                            std::map<std::string, double> &metrics,
                            bool useFaceRect)
 {
-    if (img.channels() != 3) {
+    FaceTiming::Timer timer(FaceTiming::SET_OVER_EXPOSURE);
+    if (!FaceMetrics::supported(img)) {
         // this would be an error
         metrics["OverExposure"] = -1;
         metrics["OverExposureFace"] = -1;
         return;
     }
 
-    const double sigma = 1.0 / 60.0;
-    const int Lthresh = 80, Cthresh = 40;
-
-    cv::Mat img_lab;
-
-    cv::Rect mask = cv::Rect(0, 0, img.cols, img.rows);
     if (useFaceRect) {
         if (metrics["CvFrontalFaceFound"] < 1) {
             metrics["OverExposureFace"] = -1;
             return;
         }
         // we know we want to use the face rect and have a frontal face found
-        mask =
+        cv::Rect mask =
             cv::Rect((int)metrics["CvFaceX"], (int)metrics["CvFaceY"],
                      (int)metrics["CvFaceWidth"], (int)metrics["CvFaceHeight"]);
-    }
-
-    cv::Mat maskImg = img(mask);
-    cvtColor(maskImg, img_lab, cv::COLOR_BGR2Lab );
-
-    std::vector<cv::Mat> planes_lab;
-    split(img_lab, planes_lab);
-
-    int good = 0, bad = 0;
-    for (int y = 0; y < maskImg.rows; y++) {
-        for (int x = 0; x < maskImg.cols; x++) {
-            cv::Vec2i ab(planes_lab[1].at<uchar>(y, x),
-                         planes_lab[2].at<uchar>(y, x));
-            int L = planes_lab[0].at<uchar>(y, x);
-            double P =
-                0.5 *
-                (tanh(sigma * ((L - Lthresh) + (Cthresh - norm(ab)))) + 1.0);
-            if (P > 0.5)
-                bad++;
-            else
-                good++;
-        }
-    }
-
-    if (useFaceRect) {
         metrics["OverExposureFace"] =
-            (good + bad > 0) ? (double)bad / (double)(good + bad) : 0.0;
+            hasPlanes(img) ? FaceMetrics::overExposure(planes, mask)
+                           : FaceMetrics::overExposure(img(mask));
     }
     else {
-        metrics["OverExposure"] =
-            (good + bad > 0) ? (double)bad / (double)(good + bad) : 0.0;
+        metrics["OverExposure"] = hasPlanes(img)
+                                      ? FaceMetrics::overExposure(planes)
+                                      : FaceMetrics::overExposure(img);
     }
 }
 
@@ -347,69 +669,53 @@ void Face::setOverExposure(const cv::Mat &img,
 void Face::setFocus(const cv::Mat &img, std::map<std::string, double> &metrics,
                     bool useFaceRect)
 {
-    const int aperture_size = 7;
-    cv::Mat imgNew = img;
-    // not convertin the image to gray
-    // the blue channel or the first channel (BGR)
-    // is a better metric than when using the grayscale image
-    if (img.channels() == 1) {
-        equalizeHist(img, imgNew);
-    }
-
-    cv::Mat src = imgNew;
+    FaceTiming::Timer timer(FaceTiming::SET_FOCUS);
     if (useFaceRect) {
         if (metrics["CvFrontalFaceFound"] < 1) {
             metrics["FocusFace"] = -1;
             return;
         }
-        src = imgNew(cv::Rect((int)metrics["CvFaceX"], (int)metrics["CvFaceY"],
-                              (int)metrics["CvFaceWidth"],
-                              (int)metrics["CvFaceHeight"]));
-    }
-
-    cv::Mat x, y;
-    Sobel(src, x, CV_32F, 1, 0, aperture_size);
-    Sobel(src, y, CV_32F, 0, 1, aperture_size);
-
-    cv::Mat m;
-    magnitude(x, y, m);
-
-    if (useFaceRect && metrics["CvFrontalFaceFound"] > 0) {
-        metrics["FocusFace"] = (double)mean(m)[0];
+        metrics["FocusFace"] = FaceMetrics::focus(
+            img, cv::Rect((int)metrics["CvFaceX"], (int)metrics["CvFaceY"],
+                          (int)metrics["CvFaceWidth"],
+                          (int)metrics["CvFaceHeight"]));
     }
     else {
-        metrics["Focus"] = (double)mean(m)[0];
+        metrics["Focus"] = FaceMetrics::focus(img);
     }
 }
 
-void Face::setFaceOffset(const cv::Mat &img,
-                         std::map<std::string, double> &metrics)
+/*
+ * only called in FULL mode
+ */
+void Face::setSkinFull(const cv::Mat &img,
+                       std::map<std::string, double> &metrics)
 {
+    FaceTiming::Timer timer(FaceTiming::SET_SKIN_FULL);
     // calculate skin of the entire image
-    if (biqtMode == FULL) {
-        cv::Mat maskImg;
-        cvSkinColorCrCb(img, maskImg);
-        metrics["SkinFull"] =
-            (float)sum(maskImg)[0] / (maskImg.rows * maskImg.cols);
-    }
+    metrics["SkinFull"] =
+        hasPlanes(img) ? FaceMetrics::skin(planes) : FaceMetrics::skin(img);
+}
 
+template <Face::FaceMode M>
+void Face::setFaceOffset(const cv::Mat &img,
+                         std::map<std::string, double> &metrics)
+{
+    FaceTiming::Timer timer(FaceTiming::SET_FACE_OFFSET);
     if (metrics["CvFrontalFaceFound"] == 1) {
         cv::Rect roi =
             cv::Rect((int)metrics["CvFaceX"], (int)metrics["CvFaceY"],
                      (int)metrics["CvFaceWidth"], (int)metrics["CvFaceHeight"]);
-        cv::Mat face = img(roi);
-        cv::Mat mask;
-        cvSkinColorCrCb(face, mask);
-        metrics["SkinFace"] = (float)sum(mask)[0] / (mask.rows * mask.cols);
-
-        if (biqtMode == FULL) {
-            cv::Moments m = moments(mask, true);
-            float xCenter = m.m10 / m.m00;
-            float yCenter = m.m01 / m.m00;
-
-            if (xCenter > 0 && yCenter > 0) {
-                metrics["FaceCenterOfMassX"] = roi.x + xCenter;
-                metrics["FaceCenterOfMassY"] = roi.y + yCenter;
+        cv::Point2f center;
+        cv::Point2f *centerOut = M == FULL ? &center : NULL;
+        metrics["SkinFace"] =
+            hasPlanes(img) ? FaceMetrics::skin(planes, roi, centerOut)
+                           : FaceMetrics::skin(img(roi), centerOut);
+
+        if (M == FULL) {
+            if (center.x > 0 && center.y > 0) {
+                metrics["FaceCenterOfMassX"] = roi.x + center.x;
+                metrics["FaceCenterOfMassY"] = roi.y + center.y;
             }
             else {
                 metrics["FaceCenterOfMassX"] = -1.0;
@@ -432,46 +738,9 @@ void Face::setFaceOffset(const cv::Mat &img,
 void Face::setBackground(const cv::Mat &img,
                          std::map<std::string, double> &metrics)
 {
-    int posX = floor(metrics["ImageWidth"] * .95) - 1;
-    int posY = floor(metrics["ImageHeight"] * .95) - 1;
-    int width = metrics["ImageWidth"] - 1 - posX;
-    int height = metrics["ImageHeight"] - 1 - posY;
-
-    // check the ul and ur corners of image
-    cv::Rect roi[2];
-    roi[0] = cv::Rect(0, 0, ceil(metrics["ImageWidth"] * 0.05),
-                      ceil(metrics["ImageHeight"] * 0.05));
-    roi[1] = cv::Rect(posX, 0, width, height);
-
-    double worstDev = -1;
-    double worstColorDiff = -1;
-    for (int i = 0; i < 2; i++) {
-        // Create an img at the roi and split the rgb channels
-        cv::Mat temp = img(roi[i]);
-        std::vector<cv::Mat> splitChannels;
-        split(temp, splitChannels);
-        cv::Scalar means[3];
-        cv::Scalar stdDevs[3];
-
-        for (int j = 0; j < 3; j++) {
-            meanStdDev(splitChannels[j], means[j], stdDevs[j]);
-
-            if ((double)stdDevs[j][0] > worstDev) {
-                worstDev = (double)stdDevs[j][0];
-            }
-        }
-
-        if (abs(means[0][0] - means[1][0]) > worstColorDiff) {
-            worstColorDiff = abs(means[0][0] - means[1][0]);
-        }
-        if (abs(means[0][0] - means[2][0]) > worstColorDiff) {
-            worstColorDiff = abs(means[0][0] - means[2][0]);
-        }
-        if (abs(means[1][0] - means[2][0]) > worstColorDiff) {
-            worstColorDiff = abs(means[1][0] - means[2][0]);
-        }
-    }
-
+    FaceTiming::Timer timer(FaceTiming::SET_BACKGROUND);
+    double worstDev, worstColorDiff;
+    FaceMetrics::background(img, worstDev, worstColorDiff);
     metrics["BGDeviation"] = worstDev;
     metrics["BGGrayness"] = worstColorDiff;
 }
@@ -484,93 +753,25 @@ void Face::setBackground(const cv::Mat &img,
 void Face::setBlur(const cv::Mat &img, std::map<std::string, double> &metrics,
                    bool useFaceRect)
 {
-    const int diffThreshold = 10;
-
-    cv::Mat blur0 = img; // original image
+    FaceTiming::Timer timer(FaceTiming::SET_BLUR);
     if (useFaceRect) {
         if (metrics["CvFrontalFaceFound"] < 1) {
             metrics["BlurFace"] = -1;
             return;
         }
-        blur0 = img(cv::Rect((int)metrics["CvFaceX"], (int)metrics["CvFaceY"],
-                             (int)metrics["CvFaceWidth"],
-                             (int)metrics["CvFaceHeight"]));
-    }
-
-    cv::Mat blur1(blur0.size(), CV_8UC3); // first blur.
-    cv::Mat blur2(blur1.size(), CV_8UC3); // second blur.
-    std::vector<cv::Mat> b0planes, b1planes, b2planes;
-    cv::Size blurSize;
-    int difference = 0; // temporary holders for differences.
-    double b0tob1 = 0,
-           b1tob2 =
-               0; // total of all distances between (b0 and b1) and (b1 and b2).
-
-    // create blurs
-    blurSize.height = blurSize.width =
-        cv::min(cv::max(blur0.rows / 20, 3), 15); // adapt the blur size based
-                                                  // on image dimensions but
-                                                  // keep it within 3 and 15.
-    cv::blur(blur0, blur1, blurSize);
-    cv::blur(blur1, blur2, blurSize);
-
-    // split into color planes
-    split(blur0, b0planes);
-    split(blur1, b1planes);
-    split(blur2, b2planes);
-
-    // calculate difference between blur0 and blur1.
-    for (int y = 0; y < blur0.rows; y++) {
-        for (int x = 0; x < blur0.cols; x++) {
-            int Rdiff, Gdiff, Bdiff;
-
-            Rdiff = Gdiff = Bdiff = 0;
-            // distance in 3d space -> sqrt(xdiff^2+ydiff^2+zdiff^2)
-            switch (b0planes.size()) {
-            case 3:
-                Rdiff = (int)b0planes[2].at<uchar>(y, x) -
-                        (int)b1planes[2].at<uchar>(y, x);
-            case 2:
-                Gdiff = (int)b0planes[1].at<uchar>(y, x) -
-                        (int)b1planes[1].at<uchar>(y, x);
-            case 1:
-                Bdiff = (int)b0planes[0].at<uchar>(y, x) -
-                        (int)b1planes[0].at<uchar>(y, x);
-            }
-            b0tob1 =
-                sqrt((double)(Bdiff * Bdiff + Gdiff * Gdiff + Rdiff * Rdiff));
-
-            Rdiff = Gdiff = Bdiff = 0;
-            switch (b1planes.size()) {
-            case 3:
-                Rdiff = (int)b1planes[2].at<uchar>(y, x) -
-                        (int)b2planes[2].at<uchar>(y, x);
-            case 2:
-                Gdiff = (int)b1planes[1].at<uchar>(y, x) -
-                        (int)b2planes[1].at<uchar>(y, x);
-            case 1:
-                Bdiff = (int)b1planes[0].at<uchar>(y, x) -
-                        (int)b2planes[0].at<uchar>(y, x);
-            }
-            b1tob2 =
-                sqrt((double)(Bdiff * Bdiff + Gdiff * Gdiff + Rdiff * Rdiff));
-
-            int diff = abs(b0tob1 - b1tob2);
-            if (diff > diffThreshold)
-                difference += diff;
-        }
-    }
-
-    if (useFaceRect && metrics["CvFrontalFaceFound"] > 0) {
-        metrics["BlurFace"] = 1.0 * difference / (blur0.rows * blur0.cols);
+        metrics["BlurFace"] = FaceMetrics::blur(
+            img(cv::Rect((int)metrics["CvFaceX"], (int)metrics["CvFaceY"],
+                         (int)metrics["CvFaceWidth"],
+                         (int)metrics["CvFaceHeight"])));
     }
     else {
-        metrics["Blur"] = 1.0 * difference / (blur0.rows * blur0.cols);
+        metrics["Blur"] = FaceMetrics::blur(img);
     }
 }
 
 void Face::setSAPLevel(std::map<std::string, double> &metrics)
 {
+    FaceTiming::Timer timer(FaceTiming::SET_SAP_LEVEL);
     // Verify pre-conditions
     if (metrics["CvFrontalFaceFound"] <= 0) {
         metrics["SAPFailureCode"] = NO_FRONTAL_FACE_FOUND;
@@ -644,9 +845,11 @@ void Face::setSAPLevel(std::map<std::string, double> &metrics)
     }
 }
 
+template <Face::FaceMode M>
 void Face::setOpenBrMetrics(const cv::Mat &img,
                             std::map<std::string, double> &metrics)
 {
+    FaceTiming::Timer timer(FaceTiming::SET_OPENBR_METRICS);
     if (metrics["CvFrontalFaceFound"] != 1) {
         return;
     }
@@ -661,10 +864,12 @@ void Face::setOpenBrMetrics(const cv::Mat &img,
         faceRect = QRectF(metrics["CvFaceX"], metrics["CvFaceY"],
                           metrics["CvFaceWidth"], metrics["CvFaceHeight"]);
     }
-    // the image passed in will be converted to gray by openbr
+    // the image passed in will be converted to gray by openbr - a no-op once
+    // OpenBR is up, as it is before getMultiFaceQuality's workers start
+    startOpenBr();
     brResult = brLandmarker.registerImage(img, faceRect, true, true);
 
-    if (biqtMode != LANDMARK) {
+    if (M != LANDMARK) {
         metrics["BrConfidence"] = brResult["confidence"];
         // capping it at 2500 then normalizing and inverting
         if (metrics["BrConfidence"] >= 2500) {
@@ -686,7 +891,7 @@ void Face::setOpenBrMetrics(const cv::Mat &img,
     metrics["BrLeftEyePosition_X"] = brResult["leftEye_x"];
     metrics["BrLeftEyePosition_Y"] = brResult["leftEye_y"];
     // set Br IPD
-    if (biqtMode != LANDMARK) {
+    if (M != LANDMARK) {
         metrics["BrIPD"] = calculateDistance(
             metrics["BrRightEyePosition_X"], metrics["BrRightEyePosition_Y"],
             metrics["BrLeftEyePosition_X"], metrics["BrLeftEyePosition_Y"]);
@@ -698,81 +903,16 @@ void Face::setOpenBrMetrics(const cv::Mat &img,
 void Face::prepMetricsWriteMapByMode(const FaceMode mode,
                                      std::map<std::string, double> &metrics)
 {
-    // first set all landmarking std::map keys since SHORT will contain
-    // all of them and FULL will contain all of
-    // using multiple ifs to keep the metrics in order
-    metrics["ImageWidth"] = -1;
-    metrics["ImageHeight"] = -1;
-
-    if (mode == FULL) {
-        metrics["ImageChannels"] = -1;
-        metrics["ImageArea"] = -1;
-        metrics["ImageRatio"] = -1;
-    }
-
-    metrics["CvFrontalFaceFound"] = 0;
-    metrics["CvProfileFaceFound"] = 0;
-    metrics["CvFaceX"] = -1;
-    metrics["CvFaceY"] = -1;
-    metrics["CvFaceWidth"] = -1;
-    metrics["CvFaceHeight"] = -1;
-
-    if (mode == FULL) {
-        metrics["SAPLevel"] = 0;
-        metrics["SAPFailureCode"] = NO_FAILURE;
-        metrics["CvNumLandmarks"] = 0;
-    }
-
-    if (mode != LANDMARK)
-        metrics["CvEyeCount"] = 0;
-
-    metrics["CvRightEyePosition_X"] = -1;
-    metrics["CvRightEyePosition_Y"] = -1;
-    metrics["CvLeftEyePosition_X"] = -1;
-    metrics["CvLeftEyePosition_Y"] = -1;
-
-    if (mode != LANDMARK) {
-        metrics["CvIPD"] = -1;
-        metrics["CvNoseCount"] = 0;
-    }
-
-    metrics["CvNosePosition_X"] = -1;
-    metrics["CvNosePosition_Y"] = -1;
-
-    if (mode != LANDMARK)
-        metrics["CvMouthCount"] = 0;
-
-    metrics["CvMouthPosition_X"] = -1;
-    metrics["CvMouthPosition_Y"] = -1;
-    metrics["BrRightEyePosition_X"] = -1;
-    metrics["BrRightEyePosition_Y"] = -1;
-    metrics["BrLeftEyePosition_X"] = -1;
-    metrics["BrLeftEyePosition_Y"] = -1;
-
-    if (mode != LANDMARK) {
-        metrics["BrIPD"] = 0;
-    }
-
-    if (mode == FULL) {
-        metrics["FaceCenterOfMassX"] = -1;
-        metrics["FaceCenterOfMassY"] = -1;
-        metrics["FaceOffsetX"] = -1;
-        metrics["FaceOffsetY"] = -1;
-        metrics["SkinFull"] = 0;
-    }
-
-    if (mode != LANDMARK)
-        metrics["SkinFace"] = 0;
-
-    if (mode == FULL) {
-        metrics["Focus"] = 0;
-        metrics["FocusFace"] = 0;
-        metrics["OverExposure"] = 0;
-        metrics["OverExposureFace"] = 0;
-        metrics["Blur"] = 0;
-        metrics["BlurFace"] = 0;
-        metrics["BGDeviation"] = 0;
-        metrics["BGGrayness"] = 0;
+    switch (mode) {
+    case FULL:
+        prepMetrics(modeMetricList<FULL>(), metrics);
+        break;
+    case SHORT:
+        prepMetrics(modeMetricList<SHORT>(), metrics);
+        break;
+    case LANDMARK:
+        prepMetrics(modeMetricList<LANDMARK>(), metrics);
+        break;
     }
 }
 
@@ -819,7 +959,11 @@ std::string Face::getSapFailureStr(int sapFailure)
 double Face::getQuality(const std::vector<char> &img_data,
                         std::map<std::string, double> &metrics, FaceMode mode)
 {
-    cv::Mat img(imdecode(cv::Mat(img_data), cv::IMREAD_COLOR));
+    cv::Mat img;
+    {
+        FaceTiming::Timer timer(FaceTiming::IMDECODE);
+        img = imdecode(cv::Mat(img_data), readFlags());
+    }
     // doing a continuous check as well on the image
     if ((img.rows == 0) || (img.cols == 0) || img.data == NULL ||
         !img.isContinuous()) {
@@ -832,7 +976,11 @@ double Face::getQuality(const std::vector<char> &img_data,
 double Face::getQuality(const std::string image_path,
                         std::map<std::string, double> &metrics, FaceMode mode)
 {
-    cv::Mat img = cv::imread(image_path);
+    cv::Mat img;
+    {
+        FaceTiming::Timer timer(FaceTiming::IMREAD);
+        img = cv::imread(image_path, readFlags());
+    }
     // doing a continuous check as well on the image
     if ((img.rows == 0) || (img.cols == 0) || img.data == NULL ||
         !img.isContinuous()) {
@@ -846,64 +994,492 @@ double Face::getQuality(const cv::Mat &img,
                         std::map<std::string, double> &metrics, FaceMode mode,
                         const cv::Rect &detected_rect)
 {
-    // biqtMode can be used throughout the setters
-    biqtMode = mode;
+    switch (mode) {
+    case FULL:
+        return getQuality<FULL>(img, metrics, detected_rect);
+    case SHORT:
+        return getQuality<SHORT>(img, metrics, detected_rect);
+    case LANDMARK:
+        return getQuality<LANDMARK>(img, metrics, detected_rect);
+    }
+    // not a mode
+    return -1;
+}
 
+template <Face::FaceMode M>
+double Face::getQuality(const cv::Mat &img,
+                        std::map<std::string, double> &metrics,
+                        const cv::Rect &detected_rect)
+{
     /* Image Metrics */
-    setWidth(img, metrics);
-    setHeight(img, metrics);
-    if (mode == FULL) {
-        setChannels(img, metrics);
-        setArea(img, metrics);
-        setRatio(img, metrics);
-    }
+    setImageMetrics<M>(img, metrics);
 
+    // gray, the skin mask and the over-exposed pixels in one pass
+    convertPlanes<M>(img);
     CvLandmarker::LandmarkResult landmarkResult =
-        cvLandmarker.getLandmarksNonThreaded(img, false, false, detected_rect);
+        cvLandmarker.getLandmarksNonThreaded(img, false, false, detected_rect,
+                                             hasPlanes(img) ? planes.gray
+                                                            : cv::Mat());
+    // a cascade that could not be loaded is an error, not a missing face
+    if (cvLandmarker.hasFailedCascade()) {
+        planesImage.release();
+        return -1;
+    }
 
-    setFace(img, metrics, landmarkResult.landmarkFaces);
-    // once we have set the face metrics we can get the SAP level
-    if (mode == FULL) {
-        setSAPLevel(metrics);
+    double quality =
+        setFaceMetrics<M>(img, metrics, landmarkResult.landmarkFaces);
+    if (M == FULL) {
+        setImageQualityMetrics(img, metrics);
     }
+    planesImage.release();
+    return quality;
+}
 
-    // only one face for now since the cv landmarker is getting the largest face
-    if (landmarkResult.landmarkFaces.size() > 0) {
-        setCvNumLandmarks(metrics, landmarkResult.landmarkFaces[0]);
-        setEyeCount(img, metrics, landmarkResult.landmarkFaces[0]);
-        setNoseCount(img, metrics, landmarkResult.landmarkFaces[0]);
-        setMouthCount(img, metrics, landmarkResult.landmarkFaces[0]);
+template double Face::getQuality<Face::FULL>(const cv::Mat &,
+                                             std::map<std::string, double> &,
+                                             const cv::Rect &);
+template double Face::getQuality<Face::SHORT>(const cv::Mat &,
+                                              std::map<std::string, double> &,
+                                              const cv::Rect &);
+template double
+Face::getQuality<Face::LANDMARK>(const cv::Mat &,
+                                 std::map<std::string, double> &,
+                                 const cv::Rect &);
+
+double Face::getQualityBefore(
+    const cv::Mat &img, std::map<std::string, double> &metrics, FaceMode mode,
+    const std::chrono::steady_clock::time_point &deadline)
+{
+    switch (mode) {
+    case FULL:
+        return getQualityBefore<FULL>(img, metrics, deadline);
+    case SHORT:
+        return getQualityBefore<SHORT>(img, metrics, deadline);
+    case LANDMARK:
+        return getQualityBefore<LANDMARK>(img, metrics, deadline);
+    }
+    // not a mode
+    return -1;
+}
+
+template <Face::FaceMode M>
+double Face::getQualityBefore(
+    const cv::Mat &img, std::map<std::string, double> &metrics,
+    const std::chrono::steady_clock::time_point &deadline)
+{
+    /* Image Metrics */
+    setImageMetrics<M>(img, metrics);
+
+    // the stages this mode runs, the last one included
+    const int lastStage = (M == FULL) ? BLUR_STAGE : OPENBR_STAGE;
+
+    cv::Mat imgGray;
+    CvLandmarker::LandmarkFace landmarkFace;
+    int stage = DETECTION_STAGE;
+    for (; stage <= lastStage; stage++) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+
+        switch (stage) {
+        case DETECTION_STAGE: {
+            std::vector<CvLandmarker::LandmarkFace> landmarkFaces =
+                detectLargestFace(img, imgGray);
+            if (!landmarkFaces.empty()) {
+                landmarkFace = landmarkFaces[0];
+            }
+            setFace(img, metrics, landmarkFaces);
+            if (M == FULL) {
+                setSAPLevel(metrics);
+            }
+            break;
+        }
+        case LANDMARK_STAGE:
+            if (metrics["CvFaceFound"] > 0) {
+                if (!landmarkFace.isProfile) {
+                    landmarkFace = cvLandmarker.landmarkFace(
+                        img, imgGray, landmarkFace.faceRect);
+                }
+                setCvNumLandmarks<M>(metrics, landmarkFace);
+                setEyeCount<M>(img, metrics, landmarkFace);
+                setNoseCount<M>(img, metrics, landmarkFace);
+                setMouthCount<M>(img, metrics, landmarkFace);
+            }
+            break;
+        case SKIN_STAGE:
+            if (M != LANDMARK) {
+                if (M == FULL) {
+                    setSkinFull(img, metrics);
+                }
+                setFaceOffset<M>(img, metrics);
+            }
+            break;
+        case OPENBR_STAGE:
+            if (metrics["CvFaceFound"] > 0) {
+                setOpenBrMetrics<M>(img, metrics);
+            }
+            break;
+        case BACKGROUND_STAGE:
+            setBackground(img, metrics);
+            break;
+        case FOCUS_STAGE:
+            setFocus(img, metrics, false);
+            setFocus(img, metrics, true);
+            break;
+        case OVER_EXPOSURE_STAGE:
+            setOverExposure(img, metrics, false);
+            setOverExposure(img, metrics, true);
+            break;
+        case BLUR_STAGE:
+            setBlur(img, metrics, false);
+            setBlur(img, metrics, true);
+            break;
+        }
+    }
+    metrics["StagesCompleted"] = stage;
+    if (cvLandmarker.hasFailedCascade()) {
+        return -1;
+    }
+
+    // whatever this mode would have reported from the skipped stages
+    for (int skipped = stage; skipped <= lastStage; skipped++) {
+        for (const char **key = deadlineStageKeys[skipped]; *key != NULL;
+             key++) {
+            if (reportsMetric<M>(*key)) {
+                metrics[*key] = std::numeric_limits<double>::quiet_NaN();
+            }
+        }
+    }
+
+    if (M == LANDMARK) {
+        return 0;
+    }
+    if (stage <= OPENBR_STAGE) {
+        // the score is missing some of its inputs
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return scoreQuality(metrics);
+}
+
+bool Face::meetsQualityThreshold(const cv::Mat &img,
+                                 std::map<std::string, double> &metrics,
+                                 double threshold)
+{
+    // the quality formula only needs the SHORT metrics
+    setImageMetrics<SHORT>(img, metrics);
+
+    cv::Mat imgGray;
+    std::vector<CvLandmarker::LandmarkFace> landmarkFaces =
+        detectLargestFace(img, imgGray);
+    setFace(img, metrics, landmarkFaces);
+
+    // the weighted terms known so far and the most the others can add - every
+    // term is between 0 and 1
+    double known = 0;
+    double remaining = overallQualityMax;
+    int stage = 0;
+    while (10 * known / overallQualityMax < threshold &&
+           10 * (known + remaining) / overallQualityMax >= threshold) {
+        switch (stage++) {
+        case 0:
+            // without a frontal face the quality is 0
+            if (metrics["CvFrontalFaceFound"] < 1) {
+                remaining = 0;
+                break;
+            }
+            known += frontalWeight * metrics["CvFrontalFaceFound"];
+            remaining -= frontalWeight;
+            break;
+        case 1:
+            setFaceOffset<SHORT>(img, metrics);
+            // SkinFace should only be -1 if no face found
+            if (metrics["SkinFace"] < 0) {
+                metrics["SkinFace"] = 0;
+            }
+            known += skinWeight * metrics["SkinFace"];
+            remaining -= skinWeight;
+            break;
+        case 2: {
+            CvLandmarker::LandmarkFace landmarkFace = cvLandmarker.landmarkFace(
+                img, imgGray, landmarkFaces[0].faceRect);
+            setEyeCount<SHORT>(img, metrics, landmarkFace);
+            setNoseCount<SHORT>(img, metrics, landmarkFace);
+            setMouthCount<SHORT>(img, metrics, landmarkFace);
+            known += eyesWeight * (metrics["CvEyeCount"] / 2) +
+                     noseWeight * metrics["CvNoseCount"] +
+                     mouthWeight * metrics["CvMouthCount"];
+            remaining -= eyesWeight + noseWeight + mouthWeight;
+            break;
+        }
+        default:
+            // OpenBR - the most expensive term is the last one
+            setOpenBrMetrics<SHORT>(img, metrics);
+            known += brConfidenceWeight * metrics["BrConfidence"];
+            remaining = 0;
+            break;
+        }
+    }
+
+    metrics["QualityLowerBound"] = 10 * known / overallQualityMax;
+    metrics["QualityUpperBound"] = 10 * (known + remaining) / overallQualityMax;
+    if (cvLandmarker.hasFailedCascade()) {
+        metrics["QualityLowerBound"] = -1;
+        metrics["QualityUpperBound"] = -1;
+        return false;
+    }
+    return metrics["QualityLowerBound"] >= threshold;
+}
+
+/*
+ * detection alone, keeping the largest face as getLandmarksNonThreaded does.
+ * imgGray is set to the image the cascades run on.
+ */
+std::vector<CvLandmarker::LandmarkFace>
+Face::detectLargestFace(const cv::Mat &img, cv::Mat &imgGray)
+{
+    bool isProfile;
+    cvLandmarker.prepareGray(img, imgGray);
+    std::vector<cv::Rect> faces =
+        cvLandmarker.detectFaces(img, imgGray, isProfile);
+
+    std::vector<CvLandmarker::LandmarkFace> landmarkFaces;
+    for (unsigned int i = 0; i < faces.size(); i++) {
+        if (landmarkFaces.empty() ||
+            faces[i].area() > landmarkFaces[0].faceRect.area()) {
+            landmarkFaces.assign(1, detectedFace(faces[i], isProfile));
+        }
+    }
+    return landmarkFaces;
+}
+
+int Face::getMultiFaceQuality(
+    const std::string image_path,
+    std::vector<std::map<std::string, double>> &faceMetrics, FaceMode mode,
+    int maxThreads)
+{
+    cv::Mat img;
+    {
+        FaceTiming::Timer timer(FaceTiming::IMREAD);
+        img = cv::imread(image_path, readFlags());
+    }
+    // doing a continuous check as well on the image
+    if ((img.rows == 0) || (img.cols == 0) || img.data == NULL ||
+        !img.isContinuous()) {
+        return -1;
+    }
+
+    return getMultiFaceQuality(img, faceMetrics, mode, maxThreads);
+}
+
+int Face::getMultiFaceQuality(
+    const cv::Mat &img, std::vector<std::map<std::string, double>> &faceMetrics,
+    FaceMode mode, int maxThreads)
+{
+    switch (mode) {
+    case FULL:
+        return getMultiFaceQuality<FULL>(img, faceMetrics, maxThreads);
+    case SHORT:
+        return getMultiFaceQuality<SHORT>(img, faceMetrics, maxThreads);
+    case LANDMARK:
+        return getMultiFaceQuality<LANDMARK>(img, faceMetrics, maxThreads);
+    }
+    // not a mode
+    return -1;
+}
+
+template <Face::FaceMode M>
+int Face::getMultiFaceQuality(
+    const cv::Mat &img, std::vector<std::map<std::string, double>> &faceMetrics,
+    int maxThreads)
+{
+    /* Image Metrics */
+    std::map<std::string, double> imageMetrics;
+    setImageMetrics<M>(img, imageMetrics);
+
+    cv::Mat imgGray;
+    bool isProfile;
+    convertPlanes<M>(img);
+    cvLandmarker.prepareGray(img, imgGray,
+                             hasPlanes(img) ? planes.gray : cv::Mat());
+    std::vector<cv::Rect> faces =
+        cvLandmarker.detectFaces(img, imgGray, isProfile);
+
+    faceMetrics.assign(faces.size(), imageMetrics);
+    if (faces.empty()) {
+        planesImage.release();
+        return 0;
+    }
+    // here, not on whichever worker first registers a face
+    startOpenBr();
+
+    // landmarks, OpenBR and the face region metrics run per face on the
+    // workers, the whole image metrics once on this thread meanwhile
+    int workerCount = maxThreads > 0 ? maxThreads : threadBudget.workers;
+    workerCount = std::max(1, std::min(workerCount, (int)faces.size()));
+
+    std::atomic<size_t> nextFace(0);
+    std::vector<std::thread> workers;
+    uint32_t image = FaceTrace::currentImage();
+    FaceTiming::ImageContext timing = FaceTiming::currentImage();
+    // the first error of any thread, rethrown once every worker has joined
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto fail = [&]() {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error) {
+            error = std::current_exception();
+        }
+        // the other workers stop at their next face
+        nextFace = faces.size();
+    };
+
+    try {
+        for (int i = 0; i < workerCount; i++) {
+            workers.push_back(std::thread([&, i]() {
+                FaceThreads::pinWorker(threadBudget.pinning, i);
+                FaceTrace::setCurrentImage(image);
+                FaceTiming::setCurrentImage(timing);
+                try {
+                    size_t index;
+                    while ((index = nextFace++) < faces.size()) {
+                        CvLandmarker::LandmarkFace landmarkFace;
+                        if (isProfile) {
+                            landmarkFace = detectedFace(faces[index], true);
+                        }
+                        else {
+                            landmarkFace = cvLandmarker.landmarkFace(
+                                img, imgGray, faces[index]);
+                        }
+
+                        std::map<std::string, double> &metrics =
+                            faceMetrics[index];
+                        metrics["Quality"] = setFaceMetrics<M>(
+                            img, metrics,
+                            std::vector<CvLandmarker::LandmarkFace>(
+                                1, landmarkFace));
+                        metrics["FaceIndex"] = index;
+                        metrics["FaceCount"] = faces.size();
+                    }
+                }
+                catch (...) {
+                    fail();
+                }
+            }));
+        }
+
+        if (M == FULL) {
+            setImageQualityMetrics(img, imageMetrics);
+        }
+    }
+    catch (...) {
+        fail();
+    }
+
+    for (unsigned int i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+
+    planesImage.release();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    if (cvLandmarker.hasFailedCascade()) {
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < faceMetrics.size(); i++) {
+        std::map<std::string, double>::const_iterator it;
+        for (it = imageMetrics.begin(); it != imageMetrics.end(); ++it) {
+            faceMetrics[i][it->first] = it->second;
+        }
+    }
+    return (int)faces.size();
+}
+
+/*
+ * the metrics of the face (or no face) found - everything but the whole image
+ * quality metrics. Returns the overall quality.
+ */
+template <Face::FaceMode M>
+double Face::setFaceMetrics(
+    const cv::Mat &img, std::map<std::string, double> &metrics,
+    const std::vector<CvLandmarker::LandmarkFace> &landmarkFaces)
+{
+    setCvFaceMetrics<M>(img, metrics, landmarkFaces);
+    if (landmarkFaces.size() > 0) {
         // OpenBR
-        setOpenBrMetrics(img, metrics);
+        setOpenBrMetrics<M>(img, metrics);
     }
     // cv and br landmarks
-    if (mode == LANDMARK) {
+    if (M == LANDMARK) {
         return 0;
     }
 
     // run this in SHORT MODE to get determine skin
-    setFaceOffset(img, metrics);
+    setFaceOffset<M>(img, metrics);
 
-    if (mode == Face::FULL) {
-        // the threshold aren't used, but could be to eliminate more images
-        // likely to be FTE  best non-face threshold found at 19196.22
-        setFocus(img, metrics, false);
-        setFocus(img, metrics, true);
-        // non-face threshold found at 0.7314
-        setOverExposure(img, metrics, false);
-        setOverExposure(img, metrics, true);
-        // best non-face threshold found at 43.18254
-        setBlur(img, metrics, false);
-        setBlur(img, metrics, true);
+    if (M == FULL) {
+        setFaceQualityMetrics(img, metrics);
+    }
+
+    return scoreQuality(metrics);
+}
 
-        setBackground(img, metrics);
+/*
+ * the face found by the cv landmarker, its SAP level and landmarks
+ */
+template <Face::FaceMode M>
+void Face::setCvFaceMetrics(
+    const cv::Mat &img, std::map<std::string, double> &metrics,
+    const std::vector<CvLandmarker::LandmarkFace> &landmarkFaces)
+{
+    setFace(img, metrics, landmarkFaces);
+    // once we have set the face metrics we can get the SAP level
+    if (M == FULL) {
+        setSAPLevel(metrics);
     }
 
-    // coefficients were found using the InfoGainAtributeEval Ranker method
-    // after normalizing the parameters  BrConfidence has already been
-    // normalized from 0 to 1 and CvEyeCount will be divided by two to meet this
-    // 0-1 requirement!
+    // only one face for now since the cv landmarker is getting the largest face
+    if (landmarkFaces.size() > 0) {
+        setCvNumLandmarks<M>(metrics, landmarkFaces[0]);
+        setEyeCount<M>(img, metrics, landmarkFaces[0]);
+        setNoseCount<M>(img, metrics, landmarkFaces[0]);
+        setMouthCount<M>(img, metrics, landmarkFaces[0]);
+    }
+}
+
+/*
+ * only called in FULL mode - the quality metrics of the face region
+ */
+void Face::setFaceQualityMetrics(const cv::Mat &img,
+                                 std::map<std::string, double> &metrics)
+{
+    setFocus(img, metrics, true);
+    setOverExposure(img, metrics, true);
+    setBlur(img, metrics, true);
+}
+
+/*
+ * only called in FULL mode - the metrics over the whole image, which do not
+ * depend on the face
+ */
+void Face::setImageQualityMetrics(const cv::Mat &img,
+                                  std::map<std::string, double> &metrics)
+{
+    setSkinFull(img, metrics);
+    // the threshold aren't used, but could be to eliminate more images
+    // likely to be FTE  best non-face threshold found at 19196.22
+    setFocus(img, metrics, false);
+    // non-face threshold found at 0.7314
+    setOverExposure(img, metrics, false);
+    // best non-face threshold found at 43.18254
+    setBlur(img, metrics, false);
+
+    setBackground(img, metrics);
+}
 
+double Face::scoreQuality(std::map<std::string, double> &metrics)
+{
     // if no face found return 0
     if (metrics["CvFrontalFaceFound"] < 1) {
         return 0;
@@ -912,16 +1488,249 @@ double Face::getQuality(const cv::Mat &img,
     if (metrics["SkinFace"] < 0) {
         metrics["SkinFace"] = 0;
     }
-    // getting the max for normalization from 0 to 1
-    double overallQualityMax = 0.743 * 1 + 0.706 * (2 / 2) + 0.691 * 1.0 +
-                               0.675 * 1 + 0.606 * 1 + 0.513 * 1;
     double overallQuality =
-        ((0.743 * metrics["CvMouthCount"] +
-          0.706 * (metrics["CvEyeCount"] / 2) + 0.691 * metrics["SkinFace"] +
-          0.675 * metrics["CvFrontalFaceFound"] +
-          0.606 * metrics["CvNoseCount"] + 0.513 * metrics["BrConfidence"]) /
+        ((mouthWeight * metrics["CvMouthCount"] +
+          eyesWeight * (metrics["CvEyeCount"] / 2) +
+          skinWeight * metrics["SkinFace"] +
+          frontalWeight * metrics["CvFrontalFaceFound"] +
+          noseWeight * metrics["CvNoseCount"] +
+          brConfidenceWeight * metrics["BrConfidence"]) /
          overallQualityMax);
     // NOTE: the best determined threshold using this score is 4.54, images
     // lower than this should be re-taken (recommendation)
     return 10 * overallQuality;
 }
+
+int Face::selectBestShot(
+    const std::vector<std::string> &shotPaths,
+    std::vector<std::map<std::string, double>> &shotMetrics,
+    std::vector<int> &ranking, int topK)
+{
+    // an unreadable shot stays empty and is rejected
+    std::vector<cv::Mat> shots(shotPaths.size());
+    for (unsigned int i = 0; i < shotPaths.size(); i++) {
+        FaceTiming::Timer timer(FaceTiming::IMREAD);
+        shots[i] = cv::imread(shotPaths[i], readFlags());
+    }
+    return selectBestShot(shots, shotMetrics, ranking, topK);
+}
+
+int Face::selectBestShot(
+    const std::vector<cv::Mat> &shots,
+    std::vector<std::map<std::string, double>> &shotMetrics,
+    std::vector<int> &ranking, int topK)
+{
+    shotMetrics.assign(shots.size(), std::map<std::string, double>());
+
+    // cheap pass - detection, landmarks and skin
+    std::vector<int> survivors;
+    for (unsigned int i = 0; i < shots.size(); i++) {
+        const cv::Mat &img = shots[i];
+        std::map<std::string, double> &metrics = shotMetrics[i];
+        metrics["ShotStage"] = 0;
+        metrics["ShotScore"] = 0;
+        if (img.empty()) {
+            continue;
+        }
+
+        setImageMetrics<FULL>(img, metrics);
+
+        CvLandmarker::LandmarkResult landmarkResult =
+            cvLandmarker.getLandmarksNonThreaded(img, false, false);
+        if (cvLandmarker.hasFailedCascade()) {
+            return -1;
+        }
+        setCvFaceMetrics<FULL>(img, metrics, landmarkResult.landmarkFaces);
+        if (metrics["CvFrontalFaceFound"] < 1) {
+            continue;
+        }
+        setFaceOffset<FULL>(img, metrics);
+
+        // without OpenBR the score is missing its BrConfidence term
+        metrics["ShotScore"] = scoreQuality(metrics);
+        metrics.erase("BrConfidence");
+        metrics["ShotStage"] = 1;
+        survivors.push_back(i);
+    }
+
+    // best cheap score first, the wider face on a tie
+    std::sort(survivors.begin(), survivors.end(), [&shotMetrics](int a, int b) {
+        if (shotMetrics[a]["ShotScore"] != shotMetrics[b]["ShotScore"]) {
+            return shotMetrics[a]["ShotScore"] > shotMetrics[b]["ShotScore"];
+        }
+        return shotMetrics[a]["CvFaceWidth"] > shotMetrics[b]["CvFaceWidth"];
+    });
+
+    // OpenBR on the top k, while it can still change the winner
+    const double maxBrGain = 10 * brConfidenceWeight / overallQualityMax;
+    int winner = -1;
+    double winnerScore = -1;
+    for (int i = 0; i < (int)survivors.size() && i < topK; i++) {
+        std::map<std::string, double> &metrics = shotMetrics[survivors[i]];
+        if (metrics["ShotScore"] + maxBrGain <= winnerScore) {
+            break;
+        }
+
+        setOpenBrMetrics<FULL>(shots[survivors[i]], metrics);
+        metrics["ShotScore"] = scoreQuality(metrics);
+        metrics["ShotStage"] = 2;
+        if (metrics["ShotScore"] > winnerScore) {
+            winner = survivors[i];
+            winnerScore = metrics["ShotScore"];
+        }
+    }
+
+    // the expensive quality metrics do not change the score - only the winner
+    // needs them
+    if (winner != -1) {
+        setFaceQualityMetrics(shots[winner], shotMetrics[winner]);
+        setImageQualityMetrics(shots[winner], shotMetrics[winner]);
+        shotMetrics[winner]["ShotStage"] = 3;
+    }
+
+    ranking.clear();
+    for (unsigned int i = 0; i < shots.size(); i++) {
+        if ((int)i != winner) {
+            ranking.push_back(i);
+        }
+    }
+    // the cheap scores lack the BrConfidence term, so only shots of the same
+    // stage are ordered by score
+    std::stable_sort(ranking.begin(), ranking.end(),
+                     [&shotMetrics](int a, int b) {
+                         if (shotMetrics[a]["ShotStage"] !=
+                             shotMetrics[b]["ShotStage"]) {
+                             return shotMetrics[a]["ShotStage"] >
+                                    shotMetrics[b]["ShotStage"];
+                         }
+                         return shotMetrics[a]["ShotScore"] >
+                                shotMetrics[b]["ShotScore"];
+                     });
+    if (winner != -1) {
+        ranking.insert(ranking.begin(), winner);
+    }
+    return winner;
+}
+
+int Face::getSequenceQuality(
+    const std::string &source,
+    std::vector<std::map<std::string, double>> &frameMetrics, FaceMode mode,
+    int keyframeInterval, double minTrackingConfidence)
+{
+    cv::VideoCapture capture(source);
+    if (!capture.isOpened()) {
+        return -1;
+    }
+
+    return evaluateSequence(
+        [&capture](cv::Mat &frame) { return capture.read(frame); },
+        frameMetrics, mode, keyframeInterval, minTrackingConfidence);
+}
+
+int Face::getSequenceQuality(
+    const std::vector<std::string> &framePaths,
+    std::vector<std::map<std::string, double>> &frameMetrics, FaceMode mode,
+    int keyframeInterval, double minTrackingConfidence)
+{
+    // an unreadable frame is passed on empty and reported with quality -1
+    size_t next = 0;
+    return evaluateSequence(
+        [this, &framePaths, &next](cv::Mat &frame) {
+            if (next >= framePaths.size()) {
+                return false;
+            }
+            FaceTiming::Timer timer(FaceTiming::IMREAD);
+            frame = cv::imread(framePaths[next++], readFlags());
+            return true;
+        },
+        frameMetrics, mode, keyframeInterval, minTrackingConfidence);
+}
+
+int Face::evaluateSequence(
+    const std::function<bool(cv::Mat &)> &nextFrame,
+    std::vector<std::map<std::string, double>> &frameMetrics, FaceMode mode,
+    int keyframeInterval, double minTrackingConfidence)
+{
+    switch (mode) {
+    case FULL:
+        return evaluateSequence<FULL>(nextFrame, frameMetrics, keyframeInterval,
+                                      minTrackingConfidence);
+    case SHORT:
+        return evaluateSequence<SHORT>(nextFrame, frameMetrics,
+                                       keyframeInterval, minTrackingConfidence);
+    case LANDMARK:
+        return evaluateSequence<LANDMARK>(nextFrame, frameMetrics,
+                                          keyframeInterval,
+                                          minTrackingConfidence);
+    }
+    // not a mode
+    return -1;
+}
+
+template <Face::FaceMode M>
+int Face::evaluateSequence(
+    const std::function<bool(cv::Mat &)> &nextFrame,
+    std::vector<std::map<std::string, double>> &frameMetrics,
+    int keyframeInterval, double minTrackingConfidence)
+{
+    FaceTracker tracker;
+    int sinceKeyframe = 0;
+    int frameIndex = 0;
+    cv::Mat frame, gray;
+
+    frameMetrics.clear();
+    while (nextFrame(frame)) {
+        std::map<std::string, double> metrics;
+        metrics["FrameIndex"] = frameIndex++;
+
+        if (frame.empty()) {
+            metrics["Quality"] = -1;
+            frameMetrics.push_back(metrics);
+            tracker.reset();
+            continue;
+        }
+
+        if (frame.channels() > 2) {
+            cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+        }
+        else {
+            gray = frame;
+        }
+        // the tracker matches 8-bit templates
+        if (gray.depth() == CV_16U) {
+            gray.convertTo(gray, CV_8U, 1.0 / 257);
+        }
+
+        // keep following the face between keyframes while the match holds
+        cv::Rect faceRect;
+        bool tracked = tracker.isTracking() &&
+                       sinceKeyframe < keyframeInterval &&
+                       tracker.update(gray, faceRect) >= minTrackingConfidence;
+
+        double quality;
+        if (tracked) {
+            quality = getQuality<M>(frame, metrics, faceRect);
+            sinceKeyframe++;
+        }
+        else {
+            // keyframe - full detection, and a new face to track
+            quality = getQuality<M>(frame, metrics);
+            sinceKeyframe = 1;
+            if (metrics["CvFrontalFaceFound"] > 0) {
+                tracker.init(gray, cv::Rect((int)metrics["CvFaceX"],
+                                            (int)metrics["CvFaceY"],
+                                            (int)metrics["CvFaceWidth"],
+                                            (int)metrics["CvFaceHeight"]));
+            }
+            else {
+                tracker.reset();
+            }
+        }
+
+        metrics["Quality"] = quality;
+        metrics["Tracked"] = tracked;
+        frameMetrics.push_back(metrics);
+    }
+
+    return frameIndex;
+}
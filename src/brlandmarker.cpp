@@ -9,28 +9,86 @@
 // #######################################################################
 
 #include "brlandmarker.h"
+#include "facetiming.h"
+#include "opencv2/imgproc/imgproc.hpp"
 
-BrLandmarker::BrLandmarker() {}
+#include <QThreadPool>
+#include <cassert>
 
-BrLandmarker::~BrLandmarker() { br::Context::finalize(); }
+// br::Context is process wide, so it is shared by every BrLandmarker and only
+// finalized when the last one using it goes away
+static std::mutex contextMutex;
+static int contextUsers = 0;
+// built with the context and reused by every call, so its models stay
+// resident (and are shared by forked workers)
+static QSharedPointer<br::Transform> faceRecognition;
+// see setMaxThreads, 0 for OpenBR's own defaults
+static int maxThreads = 0;
+
+// with contextMutex held and the context running
+static void applyMaxThreads()
+{
+    if (maxThreads > 0) {
+        br::Globals->parallelism = maxThreads;
+        QThreadPool::globalInstance()->setMaxThreadCount(maxThreads);
+    }
+}
+
+BrLandmarker::BrLandmarker() : initialized(false) {}
+
+BrLandmarker::~BrLandmarker() { release(); }
+
+void BrLandmarker::release()
+{
+    std::lock_guard<std::mutex> lock(contextMutex);
+    if (initialized && --contextUsers == 0) {
+        faceRecognition.reset();
+        br::Context::finalize();
+    }
+    initialized = false;
+}
 
 // kept as void - nothing returned from br initialize
 void BrLandmarker::initialize(const std::string path)
 {
+    std::string biqt_home = getenv("BIQT_HOME");
+    sdkPath = biqt_home + "/providers/BIQTFace/config/";
+}
+
+void BrLandmarker::warmUp() { ensureInitialized(); }
+
+void BrLandmarker::setMaxThreads(int threads)
+{
+    std::lock_guard<std::mutex> lock(contextMutex);
+    maxThreads = threads;
+    if (contextUsers > 0) {
+        applyMaxThreads();
+    }
+}
+
+void BrLandmarker::ensureInitialized()
+{
+    std::lock_guard<std::mutex> lock(contextMutex);
+    if (initialized) {
+        return;
+    }
+    initialized = true;
+    if (contextUsers++ > 0) {
+        return;
+    }
+
     // stackoverflow fix, gcc is fine with char* args[0], but not visual c++
     // setting the size to 1 will probably throw an issue somewhere - TODO:
     // verify it does not  const int i=1; // OK the size is const now!
     char *args[1]; // msvc forces this to be 1 or greater, but doesn't seem to
                    // cause an issue during runtime
     // char* args[0];
-    std::string biqt_home = getenv("BIQT_HOME");
-    QString sdkPath =
-        QString::fromStdString(biqt_home + "/providers/BIQTFace/config/");
-    std::cerr << "OpenBR sdk path: " << sdkPath.toStdString().c_str()
-              << std::endl;
+    std::cerr << "OpenBR sdk path: " << sdkPath << std::endl;
     std::cerr << "Initializing OpenBR..." << std::endl;
     int argc = 0;
-    br::Context::initialize(argc, args, sdkPath, true);
+    br::Context::initialize(argc, args, QString::fromStdString(sdkPath), true);
+    applyMaxThreads();
+    faceRecognition = br::Transform::fromAlgorithm("FaceRecognition");
     std::cerr << "Done initializing OpenBR" << std::endl;
 }
 
@@ -42,22 +100,41 @@ std::map<std::string, int> BrLandmarker::registerImage(const cv::Mat &img,
                                                        bool useASEF,
                                                        bool forceDetection)
 {
-    // Initialize transforms
-    QSharedPointer<br::Transform> transform =
-        br::Transform::fromAlgorithm("FaceRecognition");
+    // Initialize transforms - OpenBR is started by warmUp on a known thread,
+    // never here on what may be a short lived worker
+    QSharedPointer<br::Transform> transform;
+    {
+        std::lock_guard<std::mutex> lock(contextMutex);
+        assert(initialized);
+        transform = faceRecognition;
+    }
+    std::map<std::string, int> result;
+    if (transform.isNull()) {
+        std::cerr << "OpenBR is not initialized" << std::endl;
+        return result;
+    }
     // QSharedPointer<br::Transform> transform2 =
     // br::Transform::fromAlgorithm("FaceQuality");
 
-    // Initialize templates
+    // Initialize templates - OpenBR takes 8-bit gray or BGR
+    cv::Mat input = img;
+    if (img.depth() == CV_16U) {
+        img.convertTo(input, CV_8U, 1.0 / 257);
+    }
+    if (input.channels() == 4) {
+        cvtColor(input, input, cv::COLOR_BGRA2BGR);
+    }
     br::Template brTemplate;
-    brTemplate.append(img);
+    brTemplate.append(input);
     brTemplate.file.appendRect(faceRect);
 
     // Enroll templates
-    brTemplate >> *transform;
+    {
+        FaceTiming::Timer timer(FaceTiming::REGISTER_IMAGE);
+        brTemplate >> *transform;
+    }
     // brTemplate >> *transform2;
 
-    std::map<std::string, int> result;
     result["rightEye_x"] = brTemplate.file.get<QPoint>("StasmRightEye").x();
     result["rightEye_y"] = brTemplate.file.get<QPoint>("StasmRightEye").y();
     result["leftEye_x"] = brTemplate.file.get<QPoint>("StasmLeftEye").x();
@@ -0,0 +1,198 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "cascadebundle.h"
+#include "opencv2/core/core.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char bundleMagic[8] = {'B', 'Q', 'F', 'C', 'S', 'B', '0', '2'};
+// the bytes of an index entry after its name
+static const size_t locationBytes = 40;
+
+CascadeBundle::CascadeBundle() : mapped(NULL), mappedSize(0) {}
+
+CascadeBundle::~CascadeBundle() { close(); }
+
+bool CascadeBundle::open(const std::string &bundlePath)
+{
+    close();
+
+    int fd = ::open(bundlePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(bundleMagic) + 4) {
+        ::close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    mapped = data;
+    mappedSize = st.st_size;
+
+    // parse the index, rejecting anything that points outside the mapping
+    const char *base = (const char *)mapped;
+    const char *cur = base;
+    const char *end = base + mappedSize;
+    if (memcmp(cur, bundleMagic, sizeof(bundleMagic)) != 0) {
+        std::cerr << "Invalid cascade bundle: " << bundlePath << std::endl;
+        close();
+        return false;
+    }
+    cur += sizeof(bundleMagic);
+
+    uint32_t count;
+    memcpy(&count, cur, sizeof(count));
+    cur += sizeof(count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t nameLength;
+        if (end - cur < (ptrdiff_t)sizeof(nameLength)) {
+            break;
+        }
+        memcpy(&nameLength, cur, sizeof(nameLength));
+        cur += sizeof(nameLength);
+
+        if (end - cur < (ptrdiff_t)(nameLength + locationBytes)) {
+            break;
+        }
+        std::string name(cur, nameLength);
+        cur += nameLength;
+
+        Location location;
+        memcpy(&location.sourceSize, cur, sizeof(uint64_t));
+        memcpy(&location.sourceMtime, cur + 8, sizeof(int64_t));
+        memcpy(&location.sourceHash, cur + 16, sizeof(uint64_t));
+        memcpy(&location.offset, cur + 24, sizeof(uint64_t));
+        memcpy(&location.length, cur + 32, sizeof(uint64_t));
+        cur += locationBytes;
+
+        if (location.offset > mappedSize ||
+            location.length > mappedSize - location.offset) {
+            break;
+        }
+        locations[name] = location;
+    }
+
+    if (locations.size() != count) {
+        std::cerr << "Truncated cascade bundle: " << bundlePath << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void CascadeBundle::close()
+{
+    if (mapped != NULL) {
+        munmap(mapped, mappedSize);
+    }
+    mapped = NULL;
+    mappedSize = 0;
+    locations.clear();
+}
+
+bool CascadeBundle::isOpen() const { return mapped != NULL; }
+
+bool CascadeBundle::load(const std::string &name, const std::string &xmlPath,
+                         cv::CascadeClassifier &classifier) const
+{
+    std::map<std::string, Location>::const_iterator it = locations.find(name);
+    if (it == locations.end()) {
+        return false;
+    }
+
+    // an xml edited after the bundle was built wins over the bundle
+    struct stat st;
+    if (stat(xmlPath.c_str(), &st) == 0) {
+        if ((uint64_t)st.st_size != it->second.sourceSize) {
+            return false;
+        }
+        if ((int64_t)st.st_mtime != it->second.sourceMtime) {
+            std::ifstream in(xmlPath.c_str(), std::ifstream::binary);
+            std::string xml((std::istreambuf_iterator<char>(in)),
+                            std::istreambuf_iterator<char>());
+            if (!in || hash(xml) != it->second.sourceHash) {
+                return false;
+            }
+        }
+    }
+
+    const char *payload = (const char *)mapped + it->second.offset;
+    cv::FileStorage fs(std::string(payload, it->second.length),
+                       cv::FileStorage::READ | cv::FileStorage::MEMORY);
+    if (!fs.isOpened()) {
+        return false;
+    }
+
+    return classifier.read(fs.getFirstTopLevelNode());
+}
+
+bool CascadeBundle::write(const std::string &bundlePath,
+                          const std::vector<Entry> &entries)
+{
+    std::ofstream out(bundlePath.c_str(), std::ofstream::binary);
+    if (!out) {
+        return false;
+    }
+
+    // the index is written first so payload offsets can be computed up front
+    uint64_t offset = sizeof(bundleMagic) + sizeof(uint32_t);
+    for (size_t i = 0; i < entries.size(); i++) {
+        offset += sizeof(uint32_t) + entries[i].name.size() + locationBytes;
+    }
+
+    out.write(bundleMagic, sizeof(bundleMagic));
+    uint32_t count = (uint32_t)entries.size();
+    out.write((const char *)&count, sizeof(count));
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        uint32_t nameLength = (uint32_t)entries[i].name.size();
+        uint64_t length = entries[i].payload.size();
+        out.write((const char *)&nameLength, sizeof(nameLength));
+        out.write(entries[i].name.data(), nameLength);
+        out.write((const char *)&entries[i].sourceSize, sizeof(uint64_t));
+        out.write((const char *)&entries[i].sourceMtime, sizeof(int64_t));
+        out.write((const char *)&entries[i].sourceHash, sizeof(uint64_t));
+        out.write((const char *)&offset, sizeof(uint64_t));
+        out.write((const char *)&length, sizeof(uint64_t));
+        offset += length;
+    }
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        out.write(entries[i].payload.data(), entries[i].payload.size());
+    }
+
+    return (bool)out;
+}
+
+uint64_t CascadeBundle::hash(const std::string &data)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < data.size(); i++) {
+        h = (h ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+    return h;
+}
@@ -9,108 +9,484 @@
 // #######################################################################
 
 #include "cvlandmarker.h"
+#include "cvskincolorcbcr.h"
+#include "facescratch.h"
+#include "facetiming.h"
+#include "facetrace.h"
 #include "opencv2/core.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+// indexed by CvLandmarker::Cascade, relative to the config directory
+static const char *cascadeFiles[CvLandmarker::CASCADE_COUNT] = {
+    "haarcascades/haarcascade_frontalface_alt2.xml",
+    // NOTE - could use ear detector after profile detection or if frontal fails
+    "haarcascades/haarcascade_profileface.xml",
+    "lbpcascades/cascade.xml",
+    "haarcascades/haarcascade_mcs_eyepair_big.xml",
+    "haarcascades/haarcascade_mcs_lefteye.xml",
+    "haarcascades/haarcascade_mcs_righteye.xml",
+    "haarcascades/haarcascade_mcs_nose.xml",
+    "haarcascades/haarcascade_mcs_mouth.xml"};
+
+static const char *cascadeNames[CvLandmarker::CASCADE_COUNT] = {
+    "haar face", "haar profile face", "lbp face", "eye pair",
+    "left eye",  "right eye",         "nose",     "mouth"};
+
+CvLandmarker::CascadeSet::CascadeSet()
+{
+    for (int i = 0; i < CASCADE_COUNT; i++) {
+        loaded[i] = false;
+    }
+}
 
-CvLandmarker::CvLandmarker() {}
+CvLandmarker::CvLandmarker()
+    : skinGuided(false), speculativeProfile(false), speculating(0),
+      maxSpeculating(std::max(1u, std::thread::hardware_concurrency())),
+      stopping(false)
+{
+    for (int i = 0; i < CASCADE_COUNT; i++) {
+        cascadeFailed[i] = false;
+    }
+    cascadeSets.push_back(std::unique_ptr<CascadeSet>(new CascadeSet()));
+    freeCascadeSets.push_back(cascadeSets[0].get());
+}
 
 bool CvLandmarker::initialize(std::string biqtPath)
 {
     std::string biqt_home = getenv("BIQT_HOME");
-    // face
-    face_haar_cascade = biqt_home + "/providers/BIQTFace/config/haarcascades/"
-                                    "haarcascade_frontalface_alt2.xml";
-    // NOTE - could use ear detector after profile detection or if frontal fails
-    face_haar_profile_cascade =
-        biqt_home +
-        "/providers/BIQTFace/config/haarcascades/haarcascade_profileface.xml";
-    face_lbp_cascade =
-        biqt_home + "/providers/BIQTFace/config/lbpcascades/cascade.xml";
-    // eyes
-    eye_pair_cascade = biqt_home + "/providers/BIQTFace/config/haarcascades/"
-                                   "haarcascade_mcs_eyepair_big.xml";
-    left_eye_cascade =
-        biqt_home +
-        "/providers/BIQTFace/config/haarcascades/haarcascade_mcs_lefteye.xml";
-    right_eye_cascade =
-        biqt_home +
-        "/providers/BIQTFace/config/haarcascades/haarcascade_mcs_righteye.xml";
-    // nose
-    nose_cascade =
-        biqt_home +
-        "/providers/BIQTFace/config/haarcascades/haarcascade_mcs_nose.xml";
-    // mouth
-    mouth_cascade =
-        biqt_home +
-        "/providers/BIQTFace/config/haarcascades/haarcascade_mcs_mouth.xml";
-
-    // load cascades
-    // FRONTAL FACE - HAAR
-    if (!haarFaceCascade.load(face_haar_cascade)) {
-        std::cerr << "Failed to load the haar face cascade from: "
-                  << face_haar_cascade << std::endl;
-        return false;
+    configDir = biqt_home + "/providers/BIQTFace/config/";
+
+    // the precompiled bundle is optional, the xml files are the fallback
+    cascadeBundle.open(configDir + "cascades.bundle");
+
+    // a missing file is still reported here rather than on first use
+    for (int i = 0; i < CASCADE_COUNT; i++) {
+        cascadePaths[i] = configDir + cascadeFiles[i];
+        std::ifstream cascadeFile(cascadePaths[i].c_str());
+        if (!cascadeFile) {
+            std::cerr << "Failed to find the " << cascadeNames[i]
+                      << " cascade at: " << cascadePaths[i] << std::endl;
+            return false;
+        }
     }
 
-    // PROFILE FACE - HAAR
-    if (!haarProfileFaceCascade.load(face_haar_profile_cascade)) {
-        std::cerr << "Failed to load the haar profile face cascade from: "
-                  << face_haar_profile_cascade << std::endl;
-        return false;
+    return true;
+}
+
+bool CvLandmarker::warmUp(bool includeProfile)
+{
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    // leased like any other use of a set - the first one while it is free
+    CascadeLease lease(*this);
+    const Cascade required[] = {LBP_FACE, LEFT_EYE, RIGHT_EYE, NOSE, MOUTH};
+    bool loaded = true;
+    for (unsigned int i = 0; i < sizeof(required) / sizeof(required[0]); i++) {
+        loaded = getCascade(*lease, required[i]) != NULL && loaded;
+    }
+    if (includeProfile) {
+        loaded = getCascade(*lease, HAAR_PROFILE_FACE) != NULL && loaded;
     }
 
-    // FRONTAL FACE - LBP
-    if (!lbpFaceCascade.load(face_lbp_cascade)) {
-        std::cerr << "Failed to load the lbp face cascade from: "
-                  << face_lbp_cascade << std::endl;
-        return false;
+    // only with the timings asked for, warmUp runs once per Face and worker
+    if (!FaceTiming::isEnabled()) {
+        return loaded;
     }
+    std::chrono::duration<double> duration =
+        std::chrono::steady_clock::now() - start;
+    std::cerr << "Loaded cascades "
+              << (cascadeBundle.isOpen() ? "from bundle" : "from xml")
+              << " in " << duration.count() << " seconds" << std::endl;
+    return loaded;
+}
 
-    // EYE PAIR - HAAR
-    if (!eyePairCascade.load(eye_pair_cascade)) {
-        std::cerr << "Failed to load the eye pair cascade from: "
-                  << eye_pair_cascade << std::endl;
-        return false;
+bool CvLandmarker::hasFailedCascade()
+{
+    std::lock_guard<std::mutex> lock(cascadeMutex);
+    for (int i = 0; i < CASCADE_COUNT; i++) {
+        if (cascadeFailed[i]) {
+            return true;
+        }
     }
+    return false;
+}
 
-    // LEFT EYE - HAAR
-    if (!leftEyeCascade.load(left_eye_cascade)) {
-        std::cerr << "Failed to load the left eye cascade from: "
-                  << left_eye_cascade << std::endl;
-        return false;
+/*
+ * returns the cascade loaded in the given set, loading it from the cascade
+ * bundle (when open and up to date) or its xml on first use. NULL if it could
+ * not be loaded. The set belongs to the thread holding its lease, so its
+ * cascades are checked and parsed without the lock - only the failures shared
+ * by every set take it. The bundle is only read once initialize opened it.
+ */
+cv::CascadeClassifier *CvLandmarker::getCascade(CascadeSet &set,
+                                                Cascade cascade)
+{
+    if (set.loaded[cascade]) {
+        return &set.cascades[cascade];
+    }
+    {
+        std::lock_guard<std::mutex> lock(cascadeMutex);
+        if (cascadeFailed[cascade]) {
+            return NULL;
+        }
     }
 
-    // RIGHT EYE - HAAR
-    if (!rightEyeCascade.load(right_eye_cascade)) {
-        std::cerr << "Failed to load the right eye cascade from: "
-                  << right_eye_cascade << std::endl;
-        return false;
+    if (cascadeBundle.isOpen() &&
+        cascadeBundle.load(cascadeFiles[cascade], cascadePaths[cascade],
+                           set.cascades[cascade])) {
+        set.loaded[cascade] = true;
     }
+    else if (set.cascades[cascade].load(cascadePaths[cascade])) {
+        set.loaded[cascade] = true;
+    }
+    else {
+        std::lock_guard<std::mutex> lock(cascadeMutex);
+        if (!cascadeFailed[cascade]) {
+            std::cerr << "Failed to load the " << cascadeNames[cascade]
+                      << " cascade from: " << cascadePaths[cascade]
+                      << std::endl;
+        }
+        cascadeFailed[cascade] = true;
+    }
+    return set.loaded[cascade] ? &set.cascades[cascade] : NULL;
+}
 
-    // NOSE - HAAR
-    if (!noseCascade.load(nose_cascade)) {
-        std::cerr << "Failed to load the nose cascade from: " << nose_cascade
-                  << std::endl;
+/*
+ * runs detectMultiScale with the given cascade, false (and nothing found) if
+ * the cascade is unavailable
+ */
+bool CvLandmarker::detect(CascadeSet &set, Cascade cascade,
+                          const cv::Mat &img, std::vector<cv::Rect> &found,
+                          double scaleFactor, int minNeighbors, int flags,
+                          cv::Size minSize)
+{
+    found.clear();
+    cv::CascadeClassifier *classifier = getCascade(set, cascade);
+    if (classifier == NULL) {
         return false;
     }
+    FaceTiming::Timer timer(FaceTiming::cascadeStage(cascade));
+    classifier->detectMultiScale(img, found, scaleFactor, minNeighbors, flags,
+                                 minSize);
+    return true;
+}
 
-    // MOUTH - HAAR
-    if (!mouthCascade.load(mouth_cascade)) {
-        std::cerr << "Failed to load the mouth cascade from: " << mouth_cascade
-                  << std::endl;
-        return false;
+void CvLandmarker::setSkinGuidedDetection(bool enabled)
+{
+    skinGuided = enabled;
+}
+
+void CvLandmarker::setSpeculativeProfileDetection(bool enabled)
+{
+    speculativeProfile = enabled;
+}
+
+/*
+ * the profile cascade only finds faces turned one way - with speculative
+ * detection the mirrored image is searched as well
+ */
+void CvLandmarker::detectProfile(CascadeSet &set, const cv::Mat &imgGray,
+                                 const std::vector<cv::Rect> &regions,
+                                 std::vector<cv::Rect> &found, int flags,
+                                 cv::Size minSize,
+                                 const std::atomic<bool> *cancelled)
+{
+    detectInRegions(set, HAAR_PROFILE_FACE, imgGray, regions, found, flags,
+                    minSize, cancelled);
+    if (!speculativeProfile || isCancelled(cancelled)) {
+        return;
     }
 
-    return true;
+    cv::Mat mirrored;
+    flip(imgGray, mirrored, 1);
+    std::vector<cv::Rect> mirroredRegions = regions;
+    for (unsigned int i = 0; i < mirroredRegions.size(); i++) {
+        mirroredRegions[i].x =
+            imgGray.cols - mirroredRegions[i].x - mirroredRegions[i].width;
+    }
+    std::vector<cv::Rect> mirroredFound;
+    detectInRegions(set, HAAR_PROFILE_FACE, mirrored, mirroredRegions,
+                    mirroredFound, flags, minSize, cancelled);
+
+    size_t unmirrored = found.size();
+    for (unsigned int i = 0; i < mirroredFound.size(); i++) {
+        cv::Rect face = mirroredFound[i];
+        face.x = imgGray.cols - face.x - face.width;
+        // a face seen both ways is only kept once
+        bool seen = false;
+        for (unsigned int j = 0; j < unmirrored && !seen; j++) {
+            seen = (face & found[j]).area() * 2 > face.area();
+        }
+        if (!seen) {
+            found.push_back(face);
+        }
+    }
+
+    if ((flags & cv::CASCADE_FIND_BIGGEST_OBJECT) && found.size() > 1) {
+        cv::Rect biggest = found[0];
+        for (unsigned int i = 1; i < found.size(); i++) {
+            if (found[i].area() > biggest.area()) {
+                biggest = found[i];
+            }
+        }
+        found.assign(1, biggest);
+    }
+}
+
+/*
+ * starts detectProfile on a thread of its own, or nothing (an invalid
+ * speculation) when maxSpeculating are already running. imgGray must not be
+ * written to afterwards.
+ */
+CvLandmarker::Speculation
+CvLandmarker::speculateProfile(const cv::Mat &imgGray,
+                               const std::vector<cv::Rect> &regions,
+                               int flags, cv::Size minSize)
+{
+    Speculation speculation;
+    {
+        std::lock_guard<std::mutex> lock(cascadeMutex);
+        if (speculating >= maxSpeculating) {
+            return speculation;
+        }
+        speculating++;
+    }
+
+    std::shared_ptr<std::promise<std::vector<cv::Rect>>> profile(
+        new std::promise<std::vector<cv::Rect>>());
+    std::shared_ptr<std::atomic<bool>> cancelled(new std::atomic<bool>(false));
+    uint32_t image = FaceTrace::currentImage();
+    FaceTiming::ImageContext timing = FaceTiming::currentImage();
+    try {
+        std::thread([this, profile, cancelled, imgGray, regions, flags,
+                     minSize, image, timing]() {
+            FaceTrace::setCurrentImage(image);
+            FaceTiming::setCurrentImage(timing);
+            try {
+                std::vector<cv::Rect> found;
+                {
+                    CascadeLease set(*this);
+                    detectProfile(*set, imgGray, regions, found, flags,
+                                  minSize, cancelled.get());
+                }
+                profile->set_value(found);
+            }
+            catch (...) {
+                profile->set_exception(std::current_exception());
+            }
+
+            std::lock_guard<std::mutex> lock(cascadeMutex);
+            speculating--;
+            speculationDone.notify_all();
+        }).detach();
+    }
+    catch (...) {
+        // no thread to run it on - the caller detects profiles itself
+        std::lock_guard<std::mutex> lock(cascadeMutex);
+        speculating--;
+        speculationDone.notify_all();
+        return speculation;
+    }
+
+    speculation.result = profile->get_future().share();
+    speculation.cancelled = cancelled;
+    return speculation;
+}
+
+bool CvLandmarker::isCancelled(const std::atomic<bool> *cancelled) const
+{
+    return cancelled != NULL && (*cancelled || stopping);
+}
+
+/*
+ * the regions the face cascades search, empty for the whole image
+ */
+void CvLandmarker::faceRegions(const cv::Mat &img, cv::Size minSize,
+                               std::vector<cv::Rect> &regions)
+{
+    regions.clear();
+    if (!skinGuided) {
+        return;
+    }
+
+    cvSkinRegions(img, minSize, regions);
+    // not worth it unless most of the image is left out
+    double area = 0;
+    for (unsigned int i = 0; i < regions.size(); i++) {
+        area += regions[i].area();
+    }
+    if (area > 0.5 * img.cols * img.rows) {
+        regions.clear();
+    }
+}
+
+/*
+ * detect on the given regions of the image only, the whole image when there
+ * are none or nothing is found in them
+ */
+void CvLandmarker::detectInRegions(CascadeSet &set, Cascade cascade,
+                                   const cv::Mat &imgGray,
+                                   const std::vector<cv::Rect> &regions,
+                                   std::vector<cv::Rect> &found, int flags,
+                                   cv::Size minSize,
+                                   const std::atomic<bool> *cancelled)
+{
+    found.clear();
+    for (unsigned int i = 0; i < regions.size(); i++) {
+        if (isCancelled(cancelled)) {
+            found.clear();
+            return;
+        }
+        std::vector<cv::Rect> regionFound;
+        detect(set, cascade, imgGray(regions[i]), regionFound, 1.1, 4, flags,
+               minSize);
+        for (unsigned int j = 0; j < regionFound.size(); j++) {
+            regionFound[j].x += regions[i].x;
+            regionFound[j].y += regions[i].y;
+            found.push_back(regionFound[j]);
+        }
+    }
+
+    if (found.empty() && !isCancelled(cancelled)) {
+        detect(set, cascade, imgGray, found, 1.1, 4, flags, minSize);
+    }
+    else if ((flags & cv::CASCADE_FIND_BIGGEST_OBJECT) && found.size() > 1) {
+        // one biggest object per region - keep the biggest of them
+        cv::Rect biggest = found[0];
+        for (unsigned int i = 1; i < found.size(); i++) {
+            if (found[i].area() > biggest.area()) {
+                biggest = found[i];
+            }
+        }
+        found.assign(1, biggest);
+    }
+}
+
+/*
+ * hands out a set no other thread is using, creating one when all are busy
+ */
+CvLandmarker::CascadeSet *CvLandmarker::acquireCascadeSet()
+{
+    std::lock_guard<std::mutex> lock(cascadeMutex);
+    if (freeCascadeSets.empty()) {
+        cascadeSets.push_back(std::unique_ptr<CascadeSet>(new CascadeSet()));
+        return cascadeSets.back().get();
+    }
+    CascadeSet *set = freeCascadeSets.back();
+    freeCascadeSets.pop_back();
+    return set;
+}
+
+void CvLandmarker::releaseCascadeSet(CascadeSet *set)
+{
+    std::lock_guard<std::mutex> lock(cascadeMutex);
+    freeCascadeSets.push_back(set);
+}
+
+/*
+ * the 8-bit gray image of a gray, BGR or BGRA image of 8 or 16 bits - the
+ * cascades only take 8 bits, whatever depth the pixel metrics run at
+ */
+static void toGray(const cv::Mat &img, cv::Mat &gray)
+{
+    if (img.channels() > 2 && img.depth() == CV_8U) {
+        cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+        return;
+    }
+    cv::Mat src = img;
+    if (img.channels() > 2) {
+        cvtColor(img, src, cv::COLOR_BGR2GRAY);
+    }
+    if (src.depth() == CV_16U) {
+        src.convertTo(gray, CV_8U, 1.0 / 257);
+    }
+    else {
+        src.copyTo(gray);
+    }
+}
+
+void CvLandmarker::prepareGray(const cv::Mat &img, cv::Mat &imgGray,
+                               const cv::Mat &gray)
+{
+    FaceTiming::Timer timer(FaceTiming::GRAY);
+    if (!gray.empty()) {
+        equalizeHist(gray, imgGray);
+        return;
+    }
+    toGray(img, imgGray);
+    equalizeHist(imgGray, imgGray);
+}
+
+/*
+ * the same detection getLandmarksNonThreaded runs, keeping every face rather
+ * than the largest one
+ */
+std::vector<cv::Rect> CvLandmarker::detectFaces(const cv::Mat &img,
+                                                const cv::Mat &imgGray,
+                                                bool &isProfile)
+{
+    cv::Size minSize(64, 64);
+    std::vector<cv::Rect> faces;
+
+    isProfile = false;
+    if (imgGray.cols == 0) {
+        return faces;
+    }
+
+    std::vector<cv::Rect> regions;
+    faceRegions(img, minSize, regions);
+
+    Speculation profile;
+    if (speculativeProfile) {
+        profile = speculateProfile(imgGray, regions, 0, minSize);
+    }
+
+    CascadeLease set(*this);
+    detectInRegions(*set, LBP_FACE, imgGray, regions, faces, 0, minSize);
+    if (!faces.empty()) {
+        profile.cancel();
+    }
+    else {
+        if (profile.valid()) {
+            faces = profile.get();
+        }
+        else {
+            detectProfile(*set, imgGray, regions, faces, 0, minSize);
+        }
+        isProfile = !faces.empty();
+    }
+    return faces;
 }
 
-CvLandmarker::~CvLandmarker() {}
+CvLandmarker::LandmarkFace CvLandmarker::landmarkFace(const cv::Mat &img,
+                                                      const cv::Mat &imgGray,
+                                                      const cv::Rect &faceRect)
+{
+    cv::Mat noPreview;
+    CascadeLease set(*this);
+    return findLandmarks(*set, img, imgGray, faceRect, false, noPreview);
+}
+
+CvLandmarker::~CvLandmarker()
+{
+    // a cancelled profile detection still uses the cascade sets until it
+    // reaches its next cascade pass
+    stopping = true;
+    std::unique_lock<std::mutex> lock(cascadeMutex);
+    speculationDone.wait(lock, [this]() { return speculating == 0; });
+}
 
 void CvLandmarker::checkRectOutOfBounds(const cv::Mat &img, cv::Rect &rect) {}
 
 CvLandmarker::LandmarkResult
 CvLandmarker::getLandmarksNonThreaded(const cv::Mat &img, bool printLandmarks,
                                       bool showPreviews,
-                                      const cv::Rect &detected_rect)
+                                      const cv::Rect &detected_rect,
+                                      const cv::Mat &gray)
 {
     double duration;
     clock_t start;
@@ -126,25 +502,47 @@ CvLandmarker::getLandmarksNonThreaded(const cv::Mat &img, bool printLandmarks,
     cv::Mat imgGray = cv::Mat(img);
     std::vector<cv::Rect> facesFound;
 
-    // convert the img to gray  and then equalize equalize
-    if (img.channels() > 2) {
-        cvtColor(img, imgGray, cv::COLOR_BGR2GRAY);
-    }
-    else {
-        if (printLandmarks) {
-            std::cerr << "1 channel image??" << std::endl;
+    {
+        FaceTiming::Timer timer(FaceTiming::GRAY);
+        // convert the img to gray  and then equalize equalize
+        if (!gray.empty()) {
+            imgGray =
+                FaceScratch::get(FaceScratch::GRAY, img.rows, img.cols, CV_8U);
+            equalizeHist(gray, imgGray);
+        }
+        else {
+            if (img.channels() > 2 || img.depth() == CV_16U) {
+                imgGray = FaceScratch::get(FaceScratch::GRAY, img.rows,
+                                           img.cols, CV_8U);
+                toGray(img, imgGray);
+            }
+            else {
+                if (printLandmarks) {
+                    std::cerr << "1 channel image??" << std::endl;
+                }
+            }
+            // equalizehist
+            equalizeHist(imgGray, imgGray);
         }
     }
 
     LandmarkResult landmarkResult;
+    CascadeLease set(*this);
     cv::Size minSize(64, 64);
-    // equalizehist
-    equalizeHist(imgGray, imgGray);
+    std::vector<cv::Rect> regions;
+    Speculation profile;
     if (imgGray.cols > 0) {
         if (detected_rect.area() == 0) {
-            lbpFaceCascade.detectMultiScale(
-                imgGray, facesFound, 1.1, 4, 0,
-                minSize); //, CV_CASCADE_FIND_BIGGEST_OBJECT); //, minSize);
+            faceRegions(img, minSize, regions);
+            if (speculativeProfile) {
+                // the gray image is a scratch buffer or the caller's pixels,
+                // so it is copied - the profile thread may outlive this call
+                profile = speculateProfile(imgGray.clone(), regions,
+                                           cv::CASCADE_FIND_BIGGEST_OBJECT,
+                                           minSize);
+            }
+            detectInRegions(*set, LBP_FACE, imgGray, regions, facesFound, 0,
+                            minSize); //, CV_CASCADE_FIND_BIGGEST_OBJECT);
         }
         else {
             facesFound.push_back(detected_rect);
@@ -170,329 +568,16 @@ CvLandmarker::getLandmarksNonThreaded(const cv::Mat &img, bool printLandmarks,
         }
 
         if (facesFound.size() > 0) {
+            profile.cancel();
             // using largest rect - there won't be more than one face
             int faceDetectionCount = 0;
             for (unsigned int i = 0; i < facesFound.size(); i++) {
                 faceDetectionCount++;
 
-                int eyePairDectionCount = 0;
-                int leftEyeDetectionCount = 0;
-                int rightEyeDetectionCount = 0;
-                int noseDetectionCount = 0;
-                int mouthDetectionCount = 0;
-
-                LandmarkFace landmarkFace;
-                landmarkFace.containsLandmarks = false;
-                landmarkFace.isProfile = false;
-                landmarkFace.numLandmarks = 0;
-                // initialize all points to -1,-1
-                // right eye
-                landmarkFace.rightEye = cv::Point(-1, -1);
-                // left eye
-                landmarkFace.leftEye = cv::Point(-1, -1);
-                // nose
-                landmarkFace.noseTip = cv::Point(-1, -1);
-                // mouth
-                landmarkFace.mouth = cv::Point(-1, -1);
-
-                // set face rect
-                landmarkFace.faceRect = facesFound[i];
-
-                int faceXStart = landmarkFace.faceRect.x;
-                int faceYStart = landmarkFace.faceRect.y;
-                int faceWidth = landmarkFace.faceRect.width;
-                int faceHeight = landmarkFace.faceRect.height;
-
-                std::vector<cv::Rect> eyesPair;
-                std::vector<cv::Rect> eyesLeft;
-                std::vector<cv::Rect> eyesRight;
-                std::vector<cv::Rect> noses;
-                std::vector<cv::Rect> mouths;
-
-                // grayscale cropped face
-                cv::Mat faceGray = imgGray(facesFound[i]);
-                // creating copy of face for showPreview
-                cv::Mat facePreview;
-                if (showPreviews) {
-                    facePreview = imgPreview(facesFound[i]);
-                }
-
-                //=========================================EYE
-                //BOX====================================
-
-                // start at faceStart and go down %60 - start at face x location
-                // and only go to the width
-                double eyeBoxStartRatio = 0.20;
-                double eyeBoxHeightRatio = 0.40;
-                cv::Rect upperRect(0, 0 + (faceHeight * eyeBoxStartRatio),
-                                   faceWidth, (faceHeight * eyeBoxHeightRatio));
-
-                if (showPreviews) {
-                    rectangle(facePreview, upperRect, cv::Scalar(0, 255, 0), 2);
-                    imshow("facePreview", facePreview);
-                    cv::waitKey();
-                }
-
-                cv::Mat upperFaceGray = faceGray(upperRect);
-                // eye pair detection
-                eyePairCascade.detectMultiScale(upperFaceGray, eyesPair, 1.1, 4,
-                                                cv::CASCADE_FIND_BIGGEST_OBJECT);
-
-                // for the pair
-                for (unsigned int j = 0; j < eyesPair.size(); j++) {
-                    // this need to be based off the face coordinates
-                    landmarkFace.eyePairRect = eyesPair[j];
-                    landmarkFace.eyePairRect.y =
-                        upperRect.y + landmarkFace.eyePairRect.y;
-
-                    if (showPreviews) {
-                        rectangle(facePreview, landmarkFace.eyePairRect,
-                                  cv::Scalar(255, 0, 255), 3);
-                        imshow("eyePairRect", facePreview);
-                        cv::waitKey();
-                    }
-
-                    eyePairDectionCount++;
-                }
-
-                //=========================================LEFT
-                //EYE====================================
-
-                // create a left side region for the left eye cascade
-                cv::Rect upperRectLeft;
-                upperRectLeft.x = upperRect.x + upperRect.width / 2;
-                upperRectLeft.y = upperRect.y;
-                upperRectLeft.width = upperRect.width / 2;
-                upperRectLeft.height = upperRect.height;
-
-                cv::Mat upperFaceLeftGray = faceGray(upperRectLeft);
-
-                // left
-                leftEyeCascade.detectMultiScale(upperFaceLeftGray, eyesLeft,
-                                                1.1, 4,
-                                                cv::CASCADE_FIND_BIGGEST_OBJECT);
-
-                for (unsigned int j = 0; j < eyesLeft.size(); j++) {
-                    leftEyeDetectionCount++;
-
-                    // must be based off of face coords
-                    landmarkFace.leftEyeRect = eyesLeft[j];
-                    landmarkFace.leftEyeRect.x =
-                        upperRectLeft.x + landmarkFace.leftEyeRect.x;
-                    landmarkFace.leftEyeRect.y =
-                        upperRectLeft.y + landmarkFace.leftEyeRect.y;
-
-                    if (showPreviews) {
-                        rectangle(facePreview, landmarkFace.leftEyeRect,
-                                  cv::Scalar(100, 0, 255), 2);
-                        imshow("leftEyeRect", facePreview);
-                        cv::waitKey();
-                    }
-
-                    // points needs to be based off the image!!
-                    cv::Point center(faceXStart + landmarkFace.leftEyeRect.x +
-                                         landmarkFace.leftEyeRect.width * 0.5,
-                                     faceYStart + landmarkFace.leftEyeRect.y +
-                                         landmarkFace.leftEyeRect.height * 0.5);
-                    landmarkFace.leftEye = center;
-
-                    if (showPreviews) {
-                        circle(imgPreview, landmarkFace.leftEye, 2,
-                               cv::Scalar(100, 0, 255), 2);
-                        imshow("landmarkFace.leftEye", imgPreview);
-                        cv::waitKey();
-                    }
-                }
-
-                //=========================================RIGHT
-                //EYE====================================
-
-                // create a right side region for the right eye cascade
-                cv::Rect upperRectRight;
-                upperRectRight.x = upperRect.x;
-                upperRectRight.y = upperRect.y;
-                upperRectRight.width = upperRect.width / 2;
-                upperRectRight.height = upperRect.height;
-
-                cv::Mat upperFaceRightGray = faceGray(upperRectRight);
-
-                // right
-                rightEyeCascade.detectMultiScale(upperFaceRightGray, eyesRight,
-                                                 1.1, 4,
-                                                 cv::CASCADE_FIND_BIGGEST_OBJECT);
-
-                for (unsigned int j = 0; j < eyesRight.size(); j++) {
-                    rightEyeDetectionCount++;
-
-                    // must be based off of face coords
-                    landmarkFace.rightEyeRect = eyesRight[j];
-                    landmarkFace.rightEyeRect.x =
-                        upperRectRight.x + landmarkFace.rightEyeRect.x;
-                    landmarkFace.rightEyeRect.y =
-                        upperRectRight.y + landmarkFace.rightEyeRect.y;
-
-                    if (showPreviews) {
-                        rectangle(facePreview, landmarkFace.rightEyeRect,
-                                  cv::Scalar(255, 0, 100), 2);
-                        imshow("rightEyeRect", facePreview);
-                        cv::waitKey();
-                    }
-
-                    // center must be based off of image coordinates
-                    cv::Point center(faceXStart + landmarkFace.rightEyeRect.x +
-                                         landmarkFace.rightEyeRect.width * 0.5,
-                                     faceYStart + landmarkFace.rightEyeRect.y +
-                                         landmarkFace.rightEyeRect.height *
-                                             0.5);
-
-                    landmarkFace.rightEye = center;
-
-                    if (showPreviews) {
-                        circle(imgPreview, landmarkFace.rightEye, 2,
-                               cv::Scalar(255, 0, 100), 2);
-                        imshow("landmarkFace.rightEye", imgPreview);
-                        cv::waitKey();
-                    }
-                }
-
-                //=========================================NOSE====================================
-
-                double noseBoxStartRatio = 0.30;
-                double noseBoxHeightRatio = 0.50;
-                // implement same bottom face protection on the nose zone that
-                // is on the mouth zone - could happen!  if the low point of the
-                // rect is beyond the image length in the bring it back to the
-                // bottom of the image!!!
-                cv::Rect middleRect(0, 0 + (faceHeight * noseBoxStartRatio),
-                                    faceWidth,
-                                    (faceHeight * noseBoxHeightRatio));
-
-                if (showPreviews) {
-                    rectangle(facePreview, middleRect, cv::Scalar(255, 0, 0),
-                              2);
-                    imshow("middleRect", facePreview);
-                    cv::waitKey();
-                }
-
-                cv::Mat middleFaceGray = faceGray(middleRect);
-
-                // nose
-                noseCascade.detectMultiScale(middleFaceGray, noses, 1.1, 4,
-                                             cv::CASCADE_FIND_BIGGEST_OBJECT);
-
-                for (unsigned int j = 0; j < noses.size(); j++) {
-                    noseDetectionCount++;
-
-                    // based off of face coordinates
-                    landmarkFace.noseRect = noses[j];
-                    landmarkFace.noseRect.x =
-                        middleRect.x + landmarkFace.noseRect.x;
-                    landmarkFace.noseRect.y =
-                        middleRect.y + landmarkFace.noseRect.y;
-
-                    if (showPreviews) {
-                        rectangle(facePreview, landmarkFace.noseRect,
-                                  cv::Scalar(0, 100, 255), 2);
-                        imshow("noseRect", facePreview);
-                        cv::waitKey();
-                    }
-
-                    // center must be based off of image coordinates
-                    cv::Point center(faceXStart + landmarkFace.noseRect.x +
-                                         landmarkFace.noseRect.width * 0.5,
-                                     faceYStart + landmarkFace.noseRect.y +
-                                         landmarkFace.noseRect.height * 0.5);
-
-                    landmarkFace.noseTip = center;
-
-                    if (showPreviews) {
-                        circle(imgPreview, landmarkFace.noseTip, 2,
-                               cv::Scalar(0, 100, 255), 2);
-                        imshow("landmarkFace.noseTip", imgPreview);
-                        cv::waitKey();
-                    }
-                }
-
-                //=========================================MOUTH====================================
-
-                // detect the mouth in the face
-                // start try to extend 10% beyond the face rect, i believe some
-                // information is lost  NOTE: if the low point of the rect is
-                // beyond the image length in the bring it back to the bottom of
-                // the image!!!
-                double mouthBoxStartRatio = 0.60;
-                double mouthBoxHeightRatio = 0.45;
-                cv::Rect lowerRect(0, 0 + (faceHeight * mouthBoxStartRatio),
-                                   faceWidth,
-                                   0 + (faceHeight * mouthBoxHeightRatio));
-                int lowerRectBottom = faceYStart + faceHeight * 1.05;
-                if (lowerRectBottom > img.rows) {
-                    lowerRect.height =
-                        lowerRect.height - (lowerRectBottom - img.rows);
-                }
-
-                // need a lower rect with image base since the lower rect
-                // extends beyond the face rect
-                cv::Rect lowerRectImg = lowerRect;
-                lowerRectImg.x = faceXStart + lowerRect.x;
-                lowerRectImg.y = faceYStart + lowerRect.y;
-                if (showPreviews) {
-                    // have to show on the full image since it goes below the
-                    // mouth
-                    rectangle(imgPreview, lowerRectImg, cv::Scalar(0, 0, 255),
-                              2);
-                    imshow("lowerRectDisp", imgPreview);
-                    cv::waitKey();
-                }
-
-                cv::Mat lowerFaceGray = imgGray(lowerRectImg);
-
-                // mouth
-                mouthCascade.detectMultiScale(
-                    lowerFaceGray, mouths, 1.1, 4,
-                    cv::CASCADE_FIND_BIGGEST_OBJECT); //, cv::Size(40, 40) );
-
-                for (unsigned int j = 0; j < mouths.size(); j++) {
-                    mouthDetectionCount++;
-
-                    // based off of face coordinates
-                    landmarkFace.mouthRect = mouths[j];
-                    landmarkFace.mouthRect.x =
-                        lowerRect.x + landmarkFace.mouthRect.x;
-                    landmarkFace.mouthRect.y =
-                        lowerRect.y + landmarkFace.mouthRect.y;
-
-                    if (showPreviews) {
-                        rectangle(facePreview, landmarkFace.mouthRect,
-                                  cv::Scalar(100, 255, 100), 2);
-                        imshow("mouthRect", facePreview);
-                        cv::waitKey();
-                    }
-
-                    // center must be based off of image coordinates
-                    cv::Point center(faceXStart + landmarkFace.mouthRect.x +
-                                         landmarkFace.mouthRect.width * 0.5,
-                                     faceYStart + landmarkFace.mouthRect.y +
-                                         landmarkFace.mouthRect.height * 0.5);
-
-                    landmarkFace.mouth = center;
-
-                    if (showPreviews) {
-                        circle(imgPreview, landmarkFace.mouth, 2,
-                               cv::Scalar(100, 255, 100), 2);
-                        imshow("landmarkFace.mouth", imgPreview);
-                        cv::waitKey();
-                    }
-                }
-
-                landmarkFace.numLandmarks =
-                    leftEyeDetectionCount + rightEyeDetectionCount +
-                    noseDetectionCount + mouthDetectionCount;
-                if (landmarkFace.numLandmarks > 0) {
-                    landmarkFace.containsLandmarks = true;
-                }
                 // push back the result
-                landmarkResult.landmarkFaces.push_back(landmarkFace);
+                landmarkResult.landmarkFaces.push_back(
+                    findLandmarks(*set, img, imgGray, facesFound[i],
+                                  showPreviews, imgPreview));
             }
         }
         else {
@@ -503,9 +588,14 @@ CvLandmarker::getLandmarksNonThreaded(const cv::Mat &img, bool printLandmarks,
 
             std::vector<cv::Rect> profileFaces;
             // try to see if there is a profile face!
-            haarProfileFaceCascade.detectMultiScale(
-                imgGray, profileFaces, 1.1, 4, cv::CASCADE_FIND_BIGGEST_OBJECT,
-                minSize);
+            // the profile cascade is only loaded the first time this happens
+            if (profile.valid()) {
+                profileFaces = profile.get();
+            }
+            else {
+                detectProfile(*set, imgGray, regions, profileFaces,
+                              cv::CASCADE_FIND_BIGGEST_OBJECT, minSize);
+            }
             if (profileFaces.size() > 0) {
                 landmarkFace.isProfile = true;
                 // searching for largest object - will be only one face
@@ -534,3 +624,321 @@ CvLandmarker::getLandmarksNonThreaded(const cv::Mat &img, bool printLandmarks,
 
     return landmarkResult;
 }
+
+/*
+ * finds the eyes, nose and mouth in one face - faces can be landmarked
+ * concurrently as long as each thread uses its own cascade set
+ */
+CvLandmarker::LandmarkFace
+CvLandmarker::findLandmarks(CascadeSet &set, const cv::Mat &img,
+                            const cv::Mat &imgGray, const cv::Rect &faceRect,
+                            bool showPreviews, cv::Mat &imgPreview)
+{
+    int eyePairDectionCount = 0;
+    int leftEyeDetectionCount = 0;
+    int rightEyeDetectionCount = 0;
+    int noseDetectionCount = 0;
+    int mouthDetectionCount = 0;
+
+    LandmarkFace landmarkFace;
+    landmarkFace.containsLandmarks = false;
+    landmarkFace.isProfile = false;
+    landmarkFace.numLandmarks = 0;
+    // initialize all points to -1,-1
+    // right eye
+    landmarkFace.rightEye = cv::Point(-1, -1);
+    // left eye
+    landmarkFace.leftEye = cv::Point(-1, -1);
+    // nose
+    landmarkFace.noseTip = cv::Point(-1, -1);
+    // mouth
+    landmarkFace.mouth = cv::Point(-1, -1);
+
+    // set face rect
+    landmarkFace.faceRect = faceRect;
+
+    int faceXStart = landmarkFace.faceRect.x;
+    int faceYStart = landmarkFace.faceRect.y;
+    int faceWidth = landmarkFace.faceRect.width;
+    int faceHeight = landmarkFace.faceRect.height;
+
+    std::vector<cv::Rect> eyesPair;
+    std::vector<cv::Rect> eyesLeft;
+    std::vector<cv::Rect> eyesRight;
+    std::vector<cv::Rect> noses;
+    std::vector<cv::Rect> mouths;
+
+    // grayscale cropped face
+    cv::Mat faceGray = imgGray(faceRect);
+    // creating copy of face for showPreview
+    cv::Mat facePreview;
+    if (showPreviews) {
+        facePreview = imgPreview(faceRect);
+    }
+
+    //=========================================EYE
+    //BOX====================================
+
+    // start at faceStart and go down %60 - start at face x location
+    // and only go to the width
+    double eyeBoxStartRatio = 0.20;
+    double eyeBoxHeightRatio = 0.40;
+    cv::Rect upperRect(0, 0 + (faceHeight * eyeBoxStartRatio), faceWidth,
+                       (faceHeight * eyeBoxHeightRatio));
+
+    if (showPreviews) {
+        rectangle(facePreview, upperRect, cv::Scalar(0, 255, 0), 2);
+        imshow("facePreview", facePreview);
+        cv::waitKey();
+    }
+
+    cv::Mat upperFaceGray = faceGray(upperRect);
+    // eye pair detection - it does not feed any landmark, so it
+    // is only run (and its cascade loaded) for the previews
+    if (showPreviews) {
+        detect(set, EYE_PAIR, upperFaceGray, eyesPair, 1.1, 4,
+               cv::CASCADE_FIND_BIGGEST_OBJECT);
+    }
+
+    // for the pair
+    for (unsigned int j = 0; j < eyesPair.size(); j++) {
+        // this need to be based off the face coordinates
+        landmarkFace.eyePairRect = eyesPair[j];
+        landmarkFace.eyePairRect.y = upperRect.y + landmarkFace.eyePairRect.y;
+
+        if (showPreviews) {
+            rectangle(facePreview, landmarkFace.eyePairRect,
+                      cv::Scalar(255, 0, 255), 3);
+            imshow("eyePairRect", facePreview);
+            cv::waitKey();
+        }
+
+        eyePairDectionCount++;
+    }
+
+    //=========================================LEFT
+    //EYE====================================
+
+    // create a left side region for the left eye cascade
+    cv::Rect upperRectLeft;
+    upperRectLeft.x = upperRect.x + upperRect.width / 2;
+    upperRectLeft.y = upperRect.y;
+    upperRectLeft.width = upperRect.width / 2;
+    upperRectLeft.height = upperRect.height;
+
+    cv::Mat upperFaceLeftGray = faceGray(upperRectLeft);
+
+    // left
+    detect(set, LEFT_EYE, upperFaceLeftGray, eyesLeft, 1.1, 4,
+           cv::CASCADE_FIND_BIGGEST_OBJECT);
+
+    for (unsigned int j = 0; j < eyesLeft.size(); j++) {
+        leftEyeDetectionCount++;
+
+        // must be based off of face coords
+        landmarkFace.leftEyeRect = eyesLeft[j];
+        landmarkFace.leftEyeRect.x =
+            upperRectLeft.x + landmarkFace.leftEyeRect.x;
+        landmarkFace.leftEyeRect.y =
+            upperRectLeft.y + landmarkFace.leftEyeRect.y;
+
+        if (showPreviews) {
+            rectangle(facePreview, landmarkFace.leftEyeRect,
+                      cv::Scalar(100, 0, 255), 2);
+            imshow("leftEyeRect", facePreview);
+            cv::waitKey();
+        }
+
+        // points needs to be based off the image!!
+        cv::Point center(faceXStart + landmarkFace.leftEyeRect.x +
+                             landmarkFace.leftEyeRect.width * 0.5,
+                         faceYStart + landmarkFace.leftEyeRect.y +
+                             landmarkFace.leftEyeRect.height * 0.5);
+        landmarkFace.leftEye = center;
+
+        if (showPreviews) {
+            circle(imgPreview, landmarkFace.leftEye, 2, cv::Scalar(100, 0, 255),
+                   2);
+            imshow("landmarkFace.leftEye", imgPreview);
+            cv::waitKey();
+        }
+    }
+
+    //=========================================RIGHT
+    //EYE====================================
+
+    // create a right side region for the right eye cascade
+    cv::Rect upperRectRight;
+    upperRectRight.x = upperRect.x;
+    upperRectRight.y = upperRect.y;
+    upperRectRight.width = upperRect.width / 2;
+    upperRectRight.height = upperRect.height;
+
+    cv::Mat upperFaceRightGray = faceGray(upperRectRight);
+
+    // right
+    detect(set, RIGHT_EYE, upperFaceRightGray, eyesRight, 1.1, 4,
+           cv::CASCADE_FIND_BIGGEST_OBJECT);
+
+    for (unsigned int j = 0; j < eyesRight.size(); j++) {
+        rightEyeDetectionCount++;
+
+        // must be based off of face coords
+        landmarkFace.rightEyeRect = eyesRight[j];
+        landmarkFace.rightEyeRect.x =
+            upperRectRight.x + landmarkFace.rightEyeRect.x;
+        landmarkFace.rightEyeRect.y =
+            upperRectRight.y + landmarkFace.rightEyeRect.y;
+
+        if (showPreviews) {
+            rectangle(facePreview, landmarkFace.rightEyeRect,
+                      cv::Scalar(255, 0, 100), 2);
+            imshow("rightEyeRect", facePreview);
+            cv::waitKey();
+        }
+
+        // center must be based off of image coordinates
+        cv::Point center(faceXStart + landmarkFace.rightEyeRect.x +
+                             landmarkFace.rightEyeRect.width * 0.5,
+                         faceYStart + landmarkFace.rightEyeRect.y +
+                             landmarkFace.rightEyeRect.height * 0.5);
+
+        landmarkFace.rightEye = center;
+
+        if (showPreviews) {
+            circle(imgPreview, landmarkFace.rightEye, 2,
+                   cv::Scalar(255, 0, 100), 2);
+            imshow("landmarkFace.rightEye", imgPreview);
+            cv::waitKey();
+        }
+    }
+
+    //=========================================NOSE====================================
+
+    double noseBoxStartRatio = 0.30;
+    double noseBoxHeightRatio = 0.50;
+    // implement same bottom face protection on the nose zone that
+    // is on the mouth zone - could happen!  if the low point of the
+    // rect is beyond the image length in the bring it back to the
+    // bottom of the image!!!
+    cv::Rect middleRect(0, 0 + (faceHeight * noseBoxStartRatio), faceWidth,
+                        (faceHeight * noseBoxHeightRatio));
+
+    if (showPreviews) {
+        rectangle(facePreview, middleRect, cv::Scalar(255, 0, 0), 2);
+        imshow("middleRect", facePreview);
+        cv::waitKey();
+    }
+
+    cv::Mat middleFaceGray = faceGray(middleRect);
+
+    // nose
+    detect(set, NOSE, middleFaceGray, noses, 1.1, 4,
+           cv::CASCADE_FIND_BIGGEST_OBJECT);
+
+    for (unsigned int j = 0; j < noses.size(); j++) {
+        noseDetectionCount++;
+
+        // based off of face coordinates
+        landmarkFace.noseRect = noses[j];
+        landmarkFace.noseRect.x = middleRect.x + landmarkFace.noseRect.x;
+        landmarkFace.noseRect.y = middleRect.y + landmarkFace.noseRect.y;
+
+        if (showPreviews) {
+            rectangle(facePreview, landmarkFace.noseRect,
+                      cv::Scalar(0, 100, 255), 2);
+            imshow("noseRect", facePreview);
+            cv::waitKey();
+        }
+
+        // center must be based off of image coordinates
+        cv::Point center(faceXStart + landmarkFace.noseRect.x +
+                             landmarkFace.noseRect.width * 0.5,
+                         faceYStart + landmarkFace.noseRect.y +
+                             landmarkFace.noseRect.height * 0.5);
+
+        landmarkFace.noseTip = center;
+
+        if (showPreviews) {
+            circle(imgPreview, landmarkFace.noseTip, 2,
+                   cv::Scalar(0, 100, 255), 2);
+            imshow("landmarkFace.noseTip", imgPreview);
+            cv::waitKey();
+        }
+    }
+
+    //=========================================MOUTH====================================
+
+    // detect the mouth in the face
+    // start try to extend 10% beyond the face rect, i believe some
+    // information is lost  NOTE: if the low point of the rect is
+    // beyond the image length in the bring it back to the bottom of
+    // the image!!!
+    double mouthBoxStartRatio = 0.60;
+    double mouthBoxHeightRatio = 0.45;
+    cv::Rect lowerRect(0, 0 + (faceHeight * mouthBoxStartRatio), faceWidth,
+                       0 + (faceHeight * mouthBoxHeightRatio));
+    int lowerRectBottom = faceYStart + faceHeight * 1.05;
+    if (lowerRectBottom > img.rows) {
+        lowerRect.height = lowerRect.height - (lowerRectBottom - img.rows);
+    }
+
+    // need a lower rect with image base since the lower rect
+    // extends beyond the face rect
+    cv::Rect lowerRectImg = lowerRect;
+    lowerRectImg.x = faceXStart + lowerRect.x;
+    lowerRectImg.y = faceYStart + lowerRect.y;
+    if (showPreviews) {
+        // have to show on the full image since it goes below the
+        // mouth
+        rectangle(imgPreview, lowerRectImg, cv::Scalar(0, 0, 255), 2);
+        imshow("lowerRectDisp", imgPreview);
+        cv::waitKey();
+    }
+
+    cv::Mat lowerFaceGray = imgGray(lowerRectImg);
+
+    // mouth
+    detect(set, MOUTH, lowerFaceGray, mouths, 1.1, 4,
+           cv::CASCADE_FIND_BIGGEST_OBJECT); //, cv::Size(40, 40) );
+
+    for (unsigned int j = 0; j < mouths.size(); j++) {
+        mouthDetectionCount++;
+
+        // based off of face coordinates
+        landmarkFace.mouthRect = mouths[j];
+        landmarkFace.mouthRect.x = lowerRect.x + landmarkFace.mouthRect.x;
+        landmarkFace.mouthRect.y = lowerRect.y + landmarkFace.mouthRect.y;
+
+        if (showPreviews) {
+            rectangle(facePreview, landmarkFace.mouthRect,
+                      cv::Scalar(100, 255, 100), 2);
+            imshow("mouthRect", facePreview);
+            cv::waitKey();
+        }
+
+        // center must be based off of image coordinates
+        cv::Point center(faceXStart + landmarkFace.mouthRect.x +
+                             landmarkFace.mouthRect.width * 0.5,
+                         faceYStart + landmarkFace.mouthRect.y +
+                             landmarkFace.mouthRect.height * 0.5);
+
+        landmarkFace.mouth = center;
+
+        if (showPreviews) {
+            circle(imgPreview, landmarkFace.mouth, 2,
+                   cv::Scalar(100, 255, 100), 2);
+            imshow("landmarkFace.mouth", imgPreview);
+            cv::waitKey();
+        }
+    }
+
+    landmarkFace.numLandmarks =
+        leftEyeDetectionCount + rightEyeDetectionCount +
+        noseDetectionCount + mouthDetectionCount;
+    if (landmarkFace.numLandmarks > 0) {
+        landmarkFace.containsLandmarks = true;
+    }
+
+    return landmarkFace;
+}
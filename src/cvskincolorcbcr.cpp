@@ -10,10 +10,27 @@
 
 #include "opencv2/imgproc.hpp"
 #include "opencv2/core.hpp"
+#include <algorithm>
 
 #include "cvskincolorcbcr.h"
+#include "facemetrics.h"
+#include "faceparallel.h"
+#include "facescratch.h"
+#include "facesimd.h"
 
-void cvSkinColorCrCb(const cv::Mat &_img, cv::Mat &mask)
+void cvSkinColorCrCb(const cv::Mat &img, cv::Mat &mask)
+{
+    // the reference only takes 8-bit BGR, see FaceMetrics::supported
+    if (FaceMetrics::backend() == FaceMetrics::REFERENCE &&
+        img.type() == CV_8UC3) {
+        cvSkinColorCrCbReference(img, mask);
+    }
+    else {
+        cvSkinColorCrCbTable(img, mask);
+    }
+}
+
+void cvSkinColorCrCbReference(const cv::Mat &_img, cv::Mat &mask)
 {
     double Cx = 109.38;
     double Cy = 152.02;
@@ -46,3 +63,148 @@ void cvSkinColorCrCb(const cv::Mat &_img, cv::Mat &mask)
         }
     }
 }
+
+/*
+ * the skin test only depends on (Cr, Cb), so it is evaluated once for each
+ * of the 65536 pairs - with the same arithmetic as the reference
+ */
+static std::vector<uchar> skinTable()
+{
+    std::vector<uchar> table(256 * 256, 0);
+    double Cx = 109.38;
+    double Cy = 152.02;
+    double theta = 2.53;
+    double ecx = 1.6;
+    double ecy = 2.41;
+    double a = 25.39;
+    double b = 14.03;
+    for (int Cr = 0; Cr < 256; Cr++) {
+        for (int Cb = 0; Cb < 256; Cb++) {
+            double x = cos(theta) * (Cb - Cx) + sin(theta) * (Cr - Cy);
+            double y = -1 * sin(theta) * (Cb - Cx) + cos(theta) * (Cr - Cy);
+
+            double distort =
+                pow(x - ecx, 2) / pow(a, 2) + pow(y - ecy, 2) / pow(b, 2);
+
+            table[Cr * 256 + Cb] = distort <= 1 ? 1 : 0;
+        }
+    }
+    return table;
+}
+
+const uchar *cvSkinColorCrCbLookup()
+{
+    static const std::vector<uchar> table = skinTable();
+    return table.data();
+}
+
+/*
+ * 8-bit color goes through cvtColor, which defines the chroma the table is
+ * indexed by, in this thread's scratch. Gray, which cvtColor does not take,
+ * and 16-bit images, which it would convert to 16-bit chroma, have a kernel
+ * of their own.
+ */
+void cvSkinColorCrCbRows(const cv::Mat &_img, cv::Mat &mask)
+{
+    const uchar *table = cvSkinColorCrCbLookup();
+    FaceSimd::SkinMask kernel = NULL;
+    if (_img.depth() == CV_16U) {
+        kernel = FaceSimd::skinMask(FaceSimd::DEPTH_16U, _img.channels());
+    }
+    else if (_img.type() == CV_8UC1) {
+        kernel = FaceSimd::skinMask(FaceSimd::DEPTH_8U, 1);
+    }
+
+    mask.create(_img.rows, _img.cols, CV_8U);
+    if (kernel != NULL) {
+        for (int row = 0; row < _img.rows; row++) {
+            kernel(_img.ptr(row), mask.ptr<uchar>(row), _img.cols, table);
+        }
+        return;
+    }
+
+    cv::Mat img =
+        FaceScratch::get(FaceScratch::YCRCB, _img.rows, _img.cols, CV_8UC3);
+    cvtColor(_img, img, cv::COLOR_BGR2YCrCb);
+    for (int row = 0; row < img.rows; row++) {
+        FaceSimd::skinLookup(img.ptr<uchar>(row), mask.ptr<uchar>(row),
+                             img.cols, table);
+    }
+}
+
+// the stripes are converted in parallel
+void cvSkinColorCrCbTable(const cv::Mat &img, cv::Mat &mask)
+{
+    mask.create(img.rows, img.cols, CV_8U);
+    FaceParallel::forStripes(img.rows, [&](int, int first, int last) {
+        cv::Mat rows = mask.rowRange(first, last);
+        cvSkinColorCrCbRows(img.rowRange(first, last), rows);
+    });
+}
+
+void cvSkinRegions(const cv::Mat &img, cv::Size minSize,
+                   std::vector<cv::Rect> &regions)
+{
+    // the mask is built at most this size, a face still covers a few pixels
+    const int maskSide = 160;
+    // added around each skin blob, relative to its size
+    const double padding = 0.25;
+
+    regions.clear();
+    if (img.empty() || img.channels() < 3) {
+        return;
+    }
+
+    double scale =
+        std::min(1.0, (double)maskSide / std::max(img.cols, img.rows));
+    cv::Mat small = img;
+    if (scale < 1) {
+        resize(img, small, cv::Size(), scale, scale, cv::INTER_AREA);
+    }
+
+    cv::Mat mask;
+    cvSkinColorCrCb(small, mask);
+    // close the holes left by the eyes, brows and mouth
+    morphologyEx(mask, mask, cv::MORPH_CLOSE,
+                 getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(5, 5)));
+
+    cv::Mat labels, stats, centroids;
+    int count = connectedComponentsWithStats(mask, labels, stats, centroids, 8);
+
+    // at least part of a face of minSize has to be skin
+    double minArea = minSize.area() * scale * scale / 4;
+    cv::Rect bounds(0, 0, img.cols, img.rows);
+    for (int i = 1; i < count; i++) {
+        if (stats.at<int>(i, cv::CC_STAT_AREA) < minArea) {
+            continue;
+        }
+
+        double x = stats.at<int>(i, cv::CC_STAT_LEFT) / scale;
+        double y = stats.at<int>(i, cv::CC_STAT_TOP) / scale;
+        double width = stats.at<int>(i, cv::CC_STAT_WIDTH) / scale;
+        double height = stats.at<int>(i, cv::CC_STAT_HEIGHT) / scale;
+        cv::Rect region((int)(x - width * padding), (int)(y - height * padding),
+                        (int)(width * (1 + 2 * padding)) + 1,
+                        (int)(height * (1 + 2 * padding)) + 1);
+        region &= bounds;
+        if (region.width >= minSize.width && region.height >= minSize.height) {
+            regions.push_back(region);
+        }
+    }
+
+    // merge overlapping regions so no face is searched for twice
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (unsigned int i = 0; i < regions.size() && !merged; i++) {
+            for (unsigned int j = i + 1; j < regions.size(); j++) {
+                if ((regions[i] & regions[j]).area() > 0) {
+                    regions[i] |= regions[j];
+                    regions.erase(regions.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+}
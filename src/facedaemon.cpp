@@ -0,0 +1,146 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "facedaemon.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+FaceDaemon::FaceDaemon() : listenFd(-1), maxClients(0), stopping(false) {}
+
+FaceDaemon::~FaceDaemon() { stop(); }
+
+bool FaceDaemon::start(const std::string &path,
+                       const FaceThreads::Budget &budget, int clientLimit)
+{
+    socketPath = path;
+    maxClients = clientLimit;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << socketPath << std::endl;
+        return false;
+    }
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    if (!face.initialize("") || !pool.start(face, budget)) {
+        std::cerr << "Failed to start the face workers" << std::endl;
+        return false;
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        std::cerr << "Failed to create the daemon socket" << std::endl;
+        return false;
+    }
+
+    // a stale socket from a previous run would make bind fail
+    unlink(socketPath.c_str());
+    mode_t oldMask = umask(0077);
+    int bound = bind(listenFd, (struct sockaddr *)&address, sizeof(address));
+    umask(oldMask);
+    if (bound != 0 || listen(listenFd, maxClients) != 0) {
+        std::cerr << "Failed to listen on " << socketPath << ": "
+                  << strerror(errno) << std::endl;
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    std::cerr << "BIQTFace daemon listening on " << socketPath << " with "
+              << pool.size() << " workers" << std::endl;
+    return true;
+}
+
+void FaceDaemon::run()
+{
+    while (!stopping) {
+        int clientFd = accept(listenFd, NULL, NULL);
+        if (clientFd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // stop() shuts the listening socket down to get us out of accept
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            if (stopping || (int)clients.size() >= maxClients) {
+                // admission control - answer without reading the request
+                FaceWire::Response busy;
+                busy.status = FaceWire::BUSY;
+                busy.quality = -1;
+                FaceWire::writeResponse(clientFd, busy);
+                close(clientFd);
+                continue;
+            }
+            clients.insert(clientFd);
+        }
+
+        std::thread(&FaceDaemon::serve, this, clientFd).detach();
+    }
+}
+
+void FaceDaemon::serve(int clientFd)
+{
+    FaceWire::Request request;
+    while (!stopping && FaceWire::readRequest(clientFd, request)) {
+        FaceWire::Response response;
+        if (!pool.evaluate(request, response)) {
+            response.status = FaceWire::FAILED;
+            response.quality = -1;
+            response.metrics.clear();
+        }
+        if (!FaceWire::writeResponse(clientFd, response)) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    close(clientFd);
+    clients.erase(clientFd);
+    clientsDone.notify_all();
+}
+
+void FaceDaemon::stop()
+{
+    if (stopping.exchange(true)) {
+        return;
+    }
+
+    if (listenFd >= 0) {
+        shutdown(listenFd, SHUT_RDWR);
+    }
+
+    // wake every connection thread blocked on a read
+    std::unique_lock<std::mutex> lock(clientsMutex);
+    std::set<int>::iterator it;
+    for (it = clients.begin(); it != clients.end(); ++it) {
+        shutdown(*it, SHUT_RDWR);
+    }
+    clientsDone.wait(lock, [this]() { return clients.empty(); });
+    lock.unlock();
+
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(socketPath.c_str());
+        listenFd = -1;
+    }
+    pool.stop();
+}
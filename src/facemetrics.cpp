@@ -0,0 +1,653 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "facemetrics.h"
+#include "cvskincolorcbcr.h"
+#include "faceparallel.h"
+#include "facescratch.h"
+#include "facesimd.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+static std::atomic<int> currentBackend(FaceMetrics::OPTIMIZED);
+static std::atomic<int> currentTileRows(0);
+
+void FaceMetrics::setBackend(Backend backend) { currentBackend = backend; }
+
+FaceMetrics::Backend FaceMetrics::backend()
+{
+    return (Backend)currentBackend.load(std::memory_order_relaxed);
+}
+
+void FaceMetrics::setTileRows(int rows)
+{
+    currentTileRows = std::max(rows, 0);
+}
+
+int FaceMetrics::tileRows()
+{
+    return currentTileRows.load(std::memory_order_relaxed);
+}
+
+bool FaceMetrics::supported(const cv::Mat &img)
+{
+    int cn = img.channels();
+    return (img.depth() == CV_8U || img.depth() == CV_16U) &&
+           (cn == 1 || cn == 3 || cn == 4);
+}
+
+/*
+ * whether the reference takes img, see supported. The formats it does not
+ * take use the optimized kernels with the REFERENCE backend too, which is
+ * logged the first time it happens.
+ */
+static bool useReference(const cv::Mat &img, bool grayToo)
+{
+    if (FaceMetrics::backend() != FaceMetrics::REFERENCE) {
+        return false;
+    }
+    if (img.depth() == CV_8U &&
+        (img.channels() == 3 || (grayToo && img.channels() == 1))) {
+        return true;
+    }
+
+    static std::atomic<bool> logged(false);
+    if (!logged.exchange(true)) {
+        std::cerr << "BIQT_FACE_REFERENCE_KERNELS: the reference only takes "
+                     "8-bit BGR (and gray for focus and blur), "
+                  << (img.depth() == CV_16U ? "16-bit" : "gray or BGRA")
+                  << " images use the optimized kernels" << std::endl;
+    }
+    return false;
+}
+
+// the kernel depth of a supported image
+static FaceSimd::Depth simdDepth(const cv::Mat &img)
+{
+    return img.depth() == CV_16U ? FaceSimd::DEPTH_16U : FaceSimd::DEPTH_8U;
+}
+
+// the rows processed at once out of rows
+static int bandRows(int rows)
+{
+    int tile = FaceMetrics::tileRows();
+    return tile > 0 && tile < rows ? tile : std::max(rows, 1);
+}
+
+/*
+ * the lookup table equalizeHist builds from the histogram of img, so a tile
+ * can be equalized as part of the whole image. When every pixel has the same
+ * value equalizeHist leaves them all at it. A 16-bit image gets a table of
+ * all its values, still equalized to 8 bits.
+ */
+template <typename T>
+static void equalizeTable(const cv::Mat &img, std::vector<uchar> &lut)
+{
+    const int values = 1 << (8 * sizeof(T));
+    std::vector<int> hist(values, 0);
+    for (int y = 0; y < img.rows; y++) {
+        const T *p = img.ptr<T>(y);
+        for (int x = 0; x < img.cols; x++) {
+            hist[p[x]]++;
+        }
+    }
+
+    int total = img.rows * img.cols;
+    int i = 0;
+    while (i < values - 1 && hist[i] == 0) {
+        i++;
+    }
+    lut.assign(values, (uchar)(i / ((values - 1) / 255)));
+    if (hist[i] == total) {
+        return;
+    }
+
+    float scale = (256 - 1.f) / (total - hist[i]);
+    int sum = 0;
+    for (lut[i++] = 0; i < values; i++) {
+        sum += hist[i];
+        lut[i] = cv::saturate_cast<uchar>(sum * scale);
+    }
+}
+
+// LUT for the 16-bit images it does not take
+static void applyTable(const cv::Mat &src, const std::vector<uchar> &lut,
+                       cv::Mat &dst)
+{
+    for (int y = 0; y < src.rows; y++) {
+        const ushort *p = src.ptr<ushort>(y);
+        uchar *q = dst.ptr<uchar>(y);
+        for (int x = 0; x < src.cols; x++) {
+            q[x] = lut[p[x]];
+        }
+    }
+}
+
+double FaceMetrics::overExposure(const cv::Mat &img)
+{
+    return useReference(img, false) ? Reference::overExposure(img)
+                                    : Optimized::overExposure(img);
+}
+
+double FaceMetrics::focus(const cv::Mat &img, const cv::Rect &roi)
+{
+    return useReference(img, true) ? Reference::focus(img, roi)
+                                   : Optimized::focus(img, roi);
+}
+
+double FaceMetrics::blur(const cv::Mat &img)
+{
+    return useReference(img, true) ? Reference::blur(img)
+                                   : Optimized::blur(img);
+}
+
+double FaceMetrics::skin(const cv::Mat &img, cv::Point2f *center)
+{
+    return useReference(img, false) ? Reference::skin(img, center)
+                                    : Optimized::skin(img, center);
+}
+
+void FaceMetrics::background(const cv::Mat &img, double &deviation,
+                             double &grayness)
+{
+    if (useReference(img, false)) {
+        Reference::background(img, deviation, grayness);
+    }
+    else {
+        Optimized::background(img, deviation, grayness);
+    }
+}
+
+// mean of the first channel of the gradient magnitude of src
+static double magnitudeMean(const cv::Mat &src, int apertureSize)
+{
+    int type = CV_MAKETYPE(CV_32F, src.channels());
+    cv::Mat x =
+        FaceScratch::get(FaceScratch::SOBEL_X, src.rows, src.cols, type);
+    cv::Mat y =
+        FaceScratch::get(FaceScratch::SOBEL_Y, src.rows, src.cols, type);
+    cv::Mat m =
+        FaceScratch::get(FaceScratch::MAGNITUDE, src.rows, src.cols, type);
+    Sobel(src, x, CV_32F, 1, 0, apertureSize);
+    Sobel(src, y, CV_32F, 0, 1, apertureSize);
+    magnitude(x, y, m);
+    return (double)mean(m)[0];
+}
+
+/*
+ * the reference decides per pixel whether 0.5 * (tanh(sigma * v) + 1) > 0.5
+ * with v = (L - 80) + (40 - |(a, b)|), which holds exactly when v > 0: with
+ * integer L, a and b the smallest positive v is about 1 / (2 * 215), far
+ * from where the rounding of tanh could matter. v > 0 is tested in integers
+ * as L - 40 > 0 and (L - 40)^2 > a^2 + b^2, on the interleaved Lab image.
+ */
+
+// a 16-bit stripe as the float input of cvtColor, which has no 16-bit Lab
+static void toFloat(const cv::Mat &src, cv::Mat &dst)
+{
+    src.convertTo(dst, CV_32F, 1.0 / 65535);
+}
+
+/*
+ * whether each gray value is over-exposed - what the color kernels decide
+ * for the BGR pixel with all three channels at it - for 8 and 16 bits
+ */
+static std::vector<uchar> grayOverExposedTable(bool wide)
+{
+    int values = wide ? 65536 : 256;
+    cv::Mat ramp(1, values, wide ? CV_16UC3 : CV_8UC3);
+    for (int v = 0; v < values; v++) {
+        if (wide) {
+            ramp.at<cv::Vec3w>(0, v) = cv::Vec3w::all((ushort)v);
+        }
+        else {
+            ramp.at<cv::Vec3b>(0, v) = cv::Vec3b::all((uchar)v);
+        }
+    }
+    cv::Mat lab;
+    if (wide) {
+        cv::Mat scaled;
+        toFloat(ramp, scaled);
+        cvtColor(scaled, lab, cv::COLOR_BGR2Lab);
+    }
+    else {
+        cvtColor(ramp, lab, cv::COLOR_BGR2Lab);
+    }
+
+    std::vector<uchar> table(values);
+    for (int v = 0; v < values; v++) {
+        table[v] =
+            wide ? FaceSimd::overExposedPixels(lab.ptr<float>() + 3 * v, 1)
+                 : FaceSimd::overExposedPixels(lab.ptr<uchar>() + 3 * v, 1);
+    }
+    return table;
+}
+
+// the pixels of a gray image whose value is set in table
+template <typename T>
+static long countTable(const cv::Mat &img, const std::vector<uchar> &table)
+{
+    return FaceParallel::sumStripes<long>(img.rows, [&](int first, int last) {
+        long count = 0;
+        for (int y = first; y < last; y++) {
+            const T *p = img.ptr<T>(y);
+            for (int x = 0; x < img.cols; x++) {
+                count += table[p[x]];
+            }
+        }
+        return count;
+    });
+}
+
+/*
+ * color is converted to Lab a stripe at a time - BGRA as it is, 16 bits
+ * through float as cvtColor has no 16-bit Lab. Gray needs no conversion, a
+ * table of its values does.
+ */
+double FaceMetrics::Optimized::overExposure(const cv::Mat &img)
+{
+    if (!supported(img)) {
+        return -1;
+    }
+
+    long total = (long)img.rows * img.cols;
+    bool wide = img.depth() == CV_16U;
+    long bad = 0;
+    if (img.channels() == 1) {
+        static const std::vector<uchar> narrowTable =
+            grayOverExposedTable(false);
+        static const std::vector<uchar> wideTable = grayOverExposedTable(true);
+        bad = wide ? countTable<ushort>(img, wideTable)
+                   : countTable<uchar>(img, narrowTable);
+        return total > 0 ? (double)bad / (double)total : 0.0;
+    }
+
+    int band = bandRows(img.rows);
+    for (int top = 0; top < img.rows; top += band) {
+        cv::Mat tile = img.rowRange(top, std::min(top + band, img.rows));
+        bad += FaceParallel::sumStripes<long>(
+            tile.rows, [&](int first, int last) {
+                cv::Mat stripe = tile.rowRange(first, last);
+                long stripeBad = 0;
+                if (wide) {
+                    cv::Mat scaled = FaceScratch::get(
+                        FaceScratch::FLOAT_BGR, stripe.rows, stripe.cols,
+                        CV_32FC(img.channels()));
+                    cv::Mat lab = FaceScratch::get(
+                        FaceScratch::LAB, stripe.rows, stripe.cols, CV_32FC3);
+                    toFloat(stripe, scaled);
+                    cvtColor(scaled, lab, cv::COLOR_BGR2Lab);
+                    for (int y = 0; y < lab.rows; y++) {
+                        stripeBad += FaceSimd::overExposedPixels(
+                            lab.ptr<float>(y), lab.cols);
+                    }
+                    return stripeBad;
+                }
+
+                cv::Mat lab = FaceScratch::get(FaceScratch::LAB, stripe.rows,
+                                               stripe.cols, CV_8UC3);
+                cvtColor(stripe, lab, cv::COLOR_BGR2Lab);
+                for (int y = 0; y < lab.rows; y++) {
+                    stripeBad += FaceSimd::overExposedPixels(
+                        lab.ptr<uchar>(y), lab.cols);
+                }
+                return stripeBad;
+            });
+    }
+
+    return total > 0 ? (double)bad / (double)total : 0.0;
+}
+
+/*
+ * the reference with its intermediates in scratch buffers. Sobel on a band
+ * of an image reads the rows around the band from the image itself, so a
+ * color band needs nothing more. A gray image is equalized band by band
+ * with the table of the whole image, with the 3 rows the aperture reaches
+ * past the band - a 16-bit one always, as equalizeHist only takes 8 bits.
+ */
+double FaceMetrics::Optimized::focus(const cv::Mat &img, const cv::Rect &roi)
+{
+    const int aperture_size = 7;
+    const int halo = aperture_size / 2;
+    cv::Rect region = roi.area() > 0 ? roi : cv::Rect(0, 0, img.cols, img.rows);
+    int band = bandRows(region.height);
+    bool gray = img.channels() == 1;
+    bool wide = img.depth() == CV_16U;
+    // the gradient of 16-bit color in 8-bit units, equalized gray is 8-bit
+    double unit = wide && !gray ? 257 : 1;
+
+    if (gray && !wide && band == region.height) {
+        cv::Mat equalized =
+            FaceScratch::get(FaceScratch::EQUALIZED, img.rows, img.cols, CV_8U);
+        equalizeHist(img, equalized);
+        return magnitudeMean(equalized(region), aperture_size);
+    }
+    if (!gray && band == region.height) {
+        return magnitudeMean(img(region), aperture_size) / unit;
+    }
+
+    std::vector<uchar> lut;
+    if (gray && wide) {
+        equalizeTable<ushort>(img, lut);
+    }
+    else if (gray) {
+        equalizeTable<uchar>(img, lut);
+    }
+
+    double sum = 0;
+    for (int top = region.y; top < region.br().y; top += band) {
+        int bottom = std::min(top + band, region.br().y);
+        cv::Mat src;
+        if (gray) {
+            int first = std::max(top - halo, 0);
+            int last = std::min(bottom + halo, img.rows);
+            cv::Mat equalized = FaceScratch::get(
+                FaceScratch::EQUALIZED, last - first, img.cols, CV_8U);
+            if (wide) {
+                applyTable(img.rowRange(first, last), lut, equalized);
+            }
+            else {
+                LUT(img.rowRange(first, last), cv::Mat(1, 256, CV_8U, &lut[0]),
+                    equalized);
+            }
+            src = equalized(cv::Rect(region.x, top - first, region.width,
+                                     bottom - top));
+        }
+        else {
+            src = img(cv::Rect(region.x, top, region.width, bottom - top));
+        }
+        sum += magnitudeMean(src, aperture_size) * src.rows * src.cols;
+    }
+    return sum / (unit * region.width * region.height);
+}
+
+/*
+ * the same sums as the reference, read from the interleaved images rather
+ * than from split planes, with a kernel per depth and channel count picked
+ * once per image. The channel order of a sum of squares does not matter, so
+ * the reference channel counts (1 to 3) give its results. A 4-channel image
+ * is measured without its alpha, where the reference returns 0, and any
+ * other image is left to the reference.
+ *
+ * Tiled, the first blur covers the band and the rows the second one reaches
+ * past it - the first reads past the band from the image itself.
+ */
+double FaceMetrics::Optimized::blur(const cv::Mat &img)
+{
+    const int diffThreshold = 10;
+    bool integer = img.depth() == CV_8U || img.depth() == CV_16U;
+    FaceSimd::BlurDifference rowDifference =
+        integer ? FaceSimd::blurDifference(simdDepth(img), img.channels())
+                : NULL;
+    if (rowDifference == NULL) {
+        return Reference::blur(img);
+    }
+
+    int side = cv::min(cv::max(img.rows / 20, 3), 15);
+    // the box covers side / 2 rows above and (side - 1) / 2 below
+    int halo = side / 2;
+    int band = bandRows(img.rows);
+
+    int difference = 0;
+    for (int top = 0; top < img.rows; top += band) {
+        int bottom = std::min(top + band, img.rows);
+        int first = std::max(top - halo, 0);
+        int last = std::min(bottom + halo, img.rows);
+
+        cv::Mat blur1 = FaceScratch::get(FaceScratch::BLUR1, last - first,
+                                         img.cols, img.type());
+        cv::Mat blur2 = FaceScratch::get(FaceScratch::BLUR2, last - first,
+                                         img.cols, img.type());
+        cv::blur(img.rowRange(first, last), blur1, cv::Size(side, side));
+        cv::blur(blur1, blur2, cv::Size(side, side));
+
+        difference += FaceParallel::sumStripes<int>(
+            bottom - top, [&](int stripeTop, int stripeBottom) {
+                int stripeDifference = 0;
+                for (int y = top + stripeTop; y < top + stripeBottom; y++) {
+                    stripeDifference += rowDifference(
+                        img.ptr(y), blur1.ptr(y - first),
+                        blur2.ptr(y - first), img.cols, diffThreshold);
+                }
+                return stripeDifference;
+            });
+    }
+
+    return 1.0 * difference / (img.rows * img.cols);
+}
+
+// the skin pixels of a stripe and the sums of their coordinates
+struct SkinSums {
+    int64_t count, sumX, sumY;
+
+    SkinSums() : count(0), sumX(0), sumY(0) {}
+
+    SkinSums &operator+=(const SkinSums &other)
+    {
+        count += other.count;
+        sumX += other.sumX;
+        sumY += other.sumY;
+        return *this;
+    }
+};
+
+// the sums of a skin mask whose first row is row top of the region
+static SkinSums sumSkin(const cv::Mat &mask, int top)
+{
+    SkinSums sums;
+    for (int y = 0; y < mask.rows; y++) {
+        const uchar *p = mask.ptr<uchar>(y);
+        int64_t rowCount = 0, rowX = 0;
+        for (int x = 0; x < mask.cols; x++) {
+            if (p[x]) {
+                rowCount++;
+                rowX += x;
+            }
+        }
+        sums.count += rowCount;
+        sums.sumX += rowX;
+        sums.sumY += rowCount * (top + y);
+    }
+    return sums;
+}
+
+// the skin fraction of a region of the given area and its center of mass
+static double skinOf(const SkinSums &sums, int64_t area, cv::Point2f *center)
+{
+    if (center != NULL) {
+        float xCenter = (double)sums.sumX / (double)sums.count;
+        float yCenter = (double)sums.sumY / (double)sums.count;
+        *center = cv::Point2f(xCenter, yCenter);
+    }
+    return (float)sums.count / area;
+}
+
+/*
+ * the moments of a binary mask are plain sums of the skin pixel coordinates,
+ * which are exact in integers and so add up the same over tiles and stripes.
+ * Each stripe builds its part of the mask in its own thread's scratch.
+ */
+double FaceMetrics::Optimized::skin(const cv::Mat &img, cv::Point2f *center)
+{
+    SkinSums sums;
+    int band = bandRows(img.rows);
+    for (int top = 0; top < img.rows; top += band) {
+        cv::Mat tile = img.rowRange(top, std::min(top + band, img.rows));
+        sums += FaceParallel::sumStripes<SkinSums>(
+            tile.rows, [&](int first, int last) {
+                cv::Mat mask = FaceScratch::get(
+                    FaceScratch::SKIN_MASK, last - first, tile.cols, CV_8U);
+                cvSkinColorCrCbRows(tile.rowRange(first, last), mask);
+                return sumSkin(mask, top + first);
+            });
+    }
+    return skinOf(sums, (int64_t)img.rows * img.cols, center);
+}
+
+/*
+ * two small corner regions - not worth a second implementation for 8-bit
+ * color. The formats the reference cannot take are measured per channel in
+ * 8-bit units over the same corners, a gray one has no color differences.
+ */
+void FaceMetrics::Optimized::background(const cv::Mat &img, double &deviation,
+                                        double &grayness)
+{
+    if (!supported(img) || (img.depth() == CV_8U && img.channels() > 1)) {
+        Reference::background(img, deviation, grayness);
+        return;
+    }
+
+    int posX = floor(img.cols * .95) - 1;
+    int posY = floor(img.rows * .95) - 1;
+    cv::Rect roi[2];
+    roi[0] = cv::Rect(0, 0, ceil(img.cols * 0.05), ceil(img.rows * 0.05));
+    roi[1] = cv::Rect(posX, 0, img.cols - 1 - posX, img.rows - 1 - posY);
+
+    int colors = std::min(img.channels(), 3);
+    double unit = img.depth() == CV_16U ? 257 : 1;
+    deviation = -1;
+    grayness = colors > 1 ? -1 : 0;
+    for (int i = 0; i < 2; i++) {
+        cv::Scalar means, stdDevs;
+        meanStdDev(img(roi[i]), means, stdDevs);
+        for (int j = 0; j < colors; j++) {
+            deviation = std::max(deviation, stdDevs[j] / unit);
+            for (int k = j + 1; k < colors; k++) {
+                grayness =
+                    std::max(grayness, std::fabs(means[j] - means[k]) / unit);
+            }
+        }
+    }
+}
+
+/*
+ * whether FaceSimd::grayAndSkin matches cvtColor and the skin table of the
+ * OpenCV in use, bit GRAY_PLANE for gray and SKIN_PLANE for the skin mask.
+ * Checked once on pseudo-random pixels, as the rounding of BGR2GRAY has
+ * changed between OpenCV releases.
+ */
+static int exactPlanes()
+{
+    cv::Mat probe(128, 64, CV_8UC3);
+    uint32_t state = 1;
+    for (int y = 0; y < probe.rows; y++) {
+        uchar *p = probe.ptr<uchar>(y);
+        for (int x = 0; x < probe.cols * 3; x++) {
+            state = state * 1664525u + 1013904223u;
+            p[x] = (uchar)(state >> 24);
+        }
+    }
+
+    cv::Mat gray(probe.rows, probe.cols, CV_8U);
+    cv::Mat skin(probe.rows, probe.cols, CV_8U);
+    for (int y = 0; y < probe.rows; y++) {
+        FaceSimd::grayAndSkin(probe.ptr<uchar>(y), gray.ptr<uchar>(y),
+                              skin.ptr<uchar>(y), probe.cols,
+                              cvSkinColorCrCbLookup());
+    }
+    cv::Mat expectedGray, expectedSkin;
+    cvtColor(probe, expectedGray, cv::COLOR_BGR2GRAY);
+    cvSkinColorCrCbTable(probe, expectedSkin);
+
+    int exact = 0;
+    if (countNonZero(gray != expectedGray) == 0) {
+        exact |= FaceMetrics::GRAY_PLANE;
+    }
+    if (countNonZero(skin != expectedSkin) == 0) {
+        exact |= FaceMetrics::SKIN_PLANE;
+    }
+    return exact;
+}
+
+/*
+ * a stripe at a time, so its pixels are still in cache for the Lab
+ * conversion after the fused one. A plane the fused pass cannot build
+ * exactly falls back to the separate conversion of the stripe.
+ */
+bool FaceMetrics::convert(const cv::Mat &img, int planes, Planes &out)
+{
+    if (backend() == REFERENCE || tileRows() > 0 || img.type() != CV_8UC3) {
+        planes = 0;
+    }
+
+    static const int exact = exactPlanes();
+    bool gray = (planes & GRAY_PLANE) != 0;
+    bool skin = (planes & SKIN_PLANE) != 0;
+    bool overExposed = (planes & OVER_EXPOSED_PLANE) != 0;
+    bool fuseGray = gray && (exact & GRAY_PLANE);
+    bool fuseSkin = skin && (exact & SKIN_PLANE);
+    // create keeps a buffer of the same size
+    cv::Mat *plane[] = {&out.gray, &out.skin, &out.overExposed};
+    for (int i = 0; i < 3; i++) {
+        if (planes & (1 << i)) {
+            plane[i]->create(img.rows, img.cols, CV_8U);
+        }
+        else {
+            plane[i]->release();
+        }
+    }
+    if (planes == 0) {
+        return false;
+    }
+
+    const uchar *table = cvSkinColorCrCbLookup();
+    FaceParallel::forStripes(img.rows, [&](int, int first, int last) {
+        cv::Mat stripe = img.rowRange(first, last);
+        if (fuseGray || fuseSkin) {
+            for (int y = first; y < last; y++) {
+                FaceSimd::grayAndSkin(
+                    img.ptr<uchar>(y), fuseGray ? out.gray.ptr<uchar>(y) : NULL,
+                    fuseSkin ? out.skin.ptr<uchar>(y) : NULL, img.cols, table);
+            }
+        }
+        if (gray && !fuseGray) {
+            cv::Mat rows = out.gray.rowRange(first, last);
+            cvtColor(stripe, rows, cv::COLOR_BGR2GRAY);
+        }
+        if (skin && !fuseSkin) {
+            cv::Mat rows = out.skin.rowRange(first, last);
+            cvSkinColorCrCbRows(stripe, rows);
+        }
+        if (overExposed) {
+            cv::Mat lab = FaceScratch::get(FaceScratch::LAB, stripe.rows,
+                                           stripe.cols, CV_8UC3);
+            cvtColor(stripe, lab, cv::COLOR_BGR2Lab);
+            for (int y = first; y < last; y++) {
+                FaceSimd::overExposedMask(lab.ptr<uchar>(y - first),
+                                          out.overExposed.ptr<uchar>(y),
+                                          img.cols);
+            }
+        }
+    });
+    return true;
+}
+
+double FaceMetrics::overExposure(const Planes &planes, const cv::Rect &roi)
+{
+    cv::Mat mask =
+        roi.area() > 0 ? planes.overExposed(roi) : planes.overExposed;
+    long total = (long)mask.rows * mask.cols;
+    return total > 0 ? (double)countNonZero(mask) / (double)total : 0.0;
+}
+
+double FaceMetrics::skin(const Planes &planes, const cv::Rect &roi,
+                         cv::Point2f *center)
+{
+    cv::Mat mask = roi.area() > 0 ? planes.skin(roi) : planes.skin;
+    SkinSums sums = FaceParallel::sumStripes<SkinSums>(
+        mask.rows, [&](int first, int last) {
+            return sumSkin(mask.rowRange(first, last), first);
+        });
+    return skinOf(sums, (int64_t)mask.rows * mask.cols, center);
+}
@@ -0,0 +1,210 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "facemetrics.h"
+#include "cvskincolorcbcr.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include <cmath>
+#include <vector>
+
+/*
+ * The original metric implementations. They define the expected results of
+ * the OPTIMIZED backend and must not change.
+ */
+
+double FaceMetrics::Reference::overExposure(const cv::Mat &img)
+{
+    if (img.channels() != 3) {
+        // this would be an error
+        return -1;
+    }
+
+    const double sigma = 1.0 / 60.0;
+    const int Lthresh = 80, Cthresh = 40;
+
+    cv::Mat img_lab;
+    cvtColor(img, img_lab, cv::COLOR_BGR2Lab);
+
+    std::vector<cv::Mat> planes_lab;
+    split(img_lab, planes_lab);
+
+    int good = 0, bad = 0;
+    for (int y = 0; y < img.rows; y++) {
+        for (int x = 0; x < img.cols; x++) {
+            cv::Vec2i ab(planes_lab[1].at<uchar>(y, x),
+                         planes_lab[2].at<uchar>(y, x));
+            int L = planes_lab[0].at<uchar>(y, x);
+            double P =
+                0.5 *
+                (tanh(sigma * ((L - Lthresh) + (Cthresh - norm(ab)))) + 1.0);
+            if (P > 0.5)
+                bad++;
+            else
+                good++;
+        }
+    }
+
+    return (good + bad > 0) ? (double)bad / (double)(good + bad) : 0.0;
+}
+
+double FaceMetrics::Reference::focus(const cv::Mat &img, const cv::Rect &roi)
+{
+    const int aperture_size = 7;
+    cv::Mat imgNew = img;
+    // not convertin the image to gray
+    // the blue channel or the first channel (BGR)
+    // is a better metric than when using the grayscale image
+    if (img.channels() == 1) {
+        // into a Mat of its own - imgNew still shares the caller's pixels
+        imgNew = cv::Mat();
+        equalizeHist(img, imgNew);
+    }
+
+    cv::Mat src = roi.area() > 0 ? imgNew(roi) : imgNew;
+
+    cv::Mat x, y;
+    Sobel(src, x, CV_32F, 1, 0, aperture_size);
+    Sobel(src, y, CV_32F, 0, 1, aperture_size);
+
+    cv::Mat m;
+    magnitude(x, y, m);
+    return (double)mean(m)[0];
+}
+
+double FaceMetrics::Reference::blur(const cv::Mat &img)
+{
+    const int diffThreshold = 10;
+
+    cv::Mat blur0 = img;                  // original image
+    cv::Mat blur1(blur0.size(), CV_8UC3); // first blur.
+    cv::Mat blur2(blur1.size(), CV_8UC3); // second blur.
+    std::vector<cv::Mat> b0planes, b1planes, b2planes;
+    cv::Size blurSize;
+    int difference = 0; // temporary holders for differences.
+    double b0tob1 = 0,
+           b1tob2 =
+               0; // total of all distances between (b0 and b1) and (b1 and b2).
+
+    // create blurs
+    blurSize.height = blurSize.width =
+        cv::min(cv::max(blur0.rows / 20, 3), 15); // adapt the blur size based
+                                                  // on image dimensions but
+                                                  // keep it within 3 and 15.
+    cv::blur(blur0, blur1, blurSize);
+    cv::blur(blur1, blur2, blurSize);
+
+    // split into color planes
+    split(blur0, b0planes);
+    split(blur1, b1planes);
+    split(blur2, b2planes);
+
+    // calculate difference between blur0 and blur1.
+    for (int y = 0; y < blur0.rows; y++) {
+        for (int x = 0; x < blur0.cols; x++) {
+            int Rdiff, Gdiff, Bdiff;
+
+            Rdiff = Gdiff = Bdiff = 0;
+            // distance in 3d space -> sqrt(xdiff^2+ydiff^2+zdiff^2)
+            switch (b0planes.size()) {
+            case 3:
+                Rdiff = (int)b0planes[2].at<uchar>(y, x) -
+                        (int)b1planes[2].at<uchar>(y, x);
+            case 2:
+                Gdiff = (int)b0planes[1].at<uchar>(y, x) -
+                        (int)b1planes[1].at<uchar>(y, x);
+            case 1:
+                Bdiff = (int)b0planes[0].at<uchar>(y, x) -
+                        (int)b1planes[0].at<uchar>(y, x);
+            }
+            b0tob1 =
+                sqrt((double)(Bdiff * Bdiff + Gdiff * Gdiff + Rdiff * Rdiff));
+
+            Rdiff = Gdiff = Bdiff = 0;
+            switch (b1planes.size()) {
+            case 3:
+                Rdiff = (int)b1planes[2].at<uchar>(y, x) -
+                        (int)b2planes[2].at<uchar>(y, x);
+            case 2:
+                Gdiff = (int)b1planes[1].at<uchar>(y, x) -
+                        (int)b2planes[1].at<uchar>(y, x);
+            case 1:
+                Bdiff = (int)b1planes[0].at<uchar>(y, x) -
+                        (int)b2planes[0].at<uchar>(y, x);
+            }
+            b1tob2 =
+                sqrt((double)(Bdiff * Bdiff + Gdiff * Gdiff + Rdiff * Rdiff));
+
+            int diff = abs(b0tob1 - b1tob2);
+            if (diff > diffThreshold)
+                difference += diff;
+        }
+    }
+
+    return 1.0 * difference / (blur0.rows * blur0.cols);
+}
+
+double FaceMetrics::Reference::skin(const cv::Mat &img, cv::Point2f *center)
+{
+    cv::Mat mask;
+    cvSkinColorCrCbReference(img, mask);
+    if (center != NULL) {
+        cv::Moments m = moments(mask, true);
+        float xCenter = m.m10 / m.m00;
+        float yCenter = m.m01 / m.m00;
+        *center = cv::Point2f(xCenter, yCenter);
+    }
+    return (float)sum(mask)[0] / (mask.rows * mask.cols);
+}
+
+void FaceMetrics::Reference::background(const cv::Mat &img,
+                                        double &deviation, double &grayness)
+{
+    int posX = floor(img.cols * .95) - 1;
+    int posY = floor(img.rows * .95) - 1;
+    int width = img.cols - 1 - posX;
+    int height = img.rows - 1 - posY;
+
+    // check the ul and ur corners of image
+    cv::Rect roi[2];
+    roi[0] = cv::Rect(0, 0, ceil(img.cols * 0.05), ceil(img.rows * 0.05));
+    roi[1] = cv::Rect(posX, 0, width, height);
+
+    double worstDev = -1;
+    double worstColorDiff = -1;
+    for (int i = 0; i < 2; i++) {
+        // Create an img at the roi and split the rgb channels
+        cv::Mat temp = img(roi[i]);
+        std::vector<cv::Mat> splitChannels;
+        split(temp, splitChannels);
+        cv::Scalar means[3];
+        cv::Scalar stdDevs[3];
+
+        for (int j = 0; j < 3; j++) {
+            meanStdDev(splitChannels[j], means[j], stdDevs[j]);
+
+            if ((double)stdDevs[j][0] > worstDev) {
+                worstDev = (double)stdDevs[j][0];
+            }
+        }
+
+        if (abs(means[0][0] - means[1][0]) > worstColorDiff) {
+            worstColorDiff = abs(means[0][0] - means[1][0]);
+        }
+        if (abs(means[0][0] - means[2][0]) > worstColorDiff) {
+            worstColorDiff = abs(means[0][0] - means[2][0]);
+        }
+        if (abs(means[1][0] - means[2][0]) > worstColorDiff) {
+            worstColorDiff = abs(means[1][0] - means[2][0]);
+        }
+    }
+
+    deviation = worstDev;
+    grayness = worstColorDiff;
+}
@@ -0,0 +1,399 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "facepool.h"
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+FacePool::FacePool() : face(NULL) {}
+
+FacePool::~FacePool() { stop(); }
+
+/*
+ * whether a header describes an image getQuality takes - 8 or 16 bits with
+ * 1, 3 or 4 channels and whole pixels per row - whose rows all end inside
+ * 64 bits of the object, with nothing left to overflow
+ */
+static bool validSharedImage(const FaceWire::SharedImage &image)
+{
+    int depth = CV_MAT_DEPTH(image.type), cn = CV_MAT_CN(image.type);
+    if (image.type != (uint32_t)CV_MAKETYPE(depth, cn) ||
+        (depth != CV_8U && depth != CV_16U) ||
+        (cn != 1 && cn != 3 && cn != 4)) {
+        return false;
+    }
+    if (image.rows == 0 || image.cols == 0 || image.rows > INT_MAX ||
+        image.cols > INT_MAX) {
+        return false;
+    }
+    uint64_t pixel = CV_ELEM_SIZE(image.type);
+    return image.step >= image.cols * pixel && image.step % pixel == 0 &&
+           image.step <= (UINT64_MAX - image.offset) / image.rows &&
+           image.offset + image.rows * image.step <= SIZE_MAX;
+}
+
+// unmaps the shared pixels on every way out of evaluateShared
+struct SharedMapping {
+    void *data;
+    size_t length;
+
+    SharedMapping() : data(MAP_FAILED), length(0) {}
+    ~SharedMapping()
+    {
+        if (data != MAP_FAILED) {
+            munmap(data, length);
+        }
+    }
+};
+
+/*
+ * maps the caller's pixels read-only and evaluates them in place, -1 if the
+ * object is missing, smaller than the header says or the header is invalid
+ */
+static double evaluateShared(Face &face, const FaceWire::Request &request,
+                             FaceWire::Response &response)
+{
+    FaceWire::SharedImage image;
+    std::string shmName;
+    if (!FaceWire::decodeSharedImage(request.payload, image, shmName) ||
+        !validSharedImage(image)) {
+        return -1;
+    }
+
+    int fd = shm_open(shmName.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    uint64_t needed = image.offset + (uint64_t)image.rows * image.step;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < needed) {
+        close(fd);
+        return -1;
+    }
+    SharedMapping mapping;
+    mapping.length = needed;
+    mapping.data = mmap(NULL, needed, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping.data == MAP_FAILED) {
+        return -1;
+    }
+
+    // getQuality never writes to its input
+    cv::Mat img(image.rows, image.cols, image.type,
+                (char *)mapping.data + image.offset, image.step);
+    return face.getQuality(img, response.metrics,
+                           (Face::FaceMode)request.mode);
+}
+
+void FacePool::evaluateRequest(Face &face, const FaceWire::Request &request,
+                               FaceWire::Response &response)
+{
+    response.status = FaceWire::OK;
+    response.quality = 0;
+    response.metrics.clear();
+
+    if (request.mode > Face::LANDMARK) {
+        response.status = FaceWire::BAD_REQUEST;
+        return;
+    }
+    Face::FaceMode mode = (Face::FaceMode)request.mode;
+
+    try {
+        if (request.kind == FaceWire::PATH) {
+            response.quality =
+                face.getQuality(request.payload, response.metrics, mode);
+        }
+        else if (request.kind == FaceWire::ENCODED) {
+            std::vector<char> encoded(request.payload.begin(),
+                                      request.payload.end());
+            response.quality = face.getQuality(encoded, response.metrics, mode);
+        }
+        else if (request.kind == FaceWire::SHARED_MEMORY) {
+            response.quality = evaluateShared(face, request, response);
+        }
+        else {
+            response.status = FaceWire::BAD_REQUEST;
+            return;
+        }
+    }
+    catch (const std::exception &e) {
+        std::cerr << "Face evaluation failed: " << e.what() << std::endl;
+        response.status = FaceWire::FAILED;
+        response.metrics.clear();
+        return;
+    }
+
+    if (response.quality == -1) {
+        response.status = FaceWire::DECODE_ERROR;
+    }
+}
+
+// runs in the forked worker until the parent closes its end
+static void workerLoop(Face &face, int fd)
+{
+    FaceWire::Request request;
+    while (FaceWire::readRequest(fd, request)) {
+        FaceWire::Response response;
+        FacePool::evaluateRequest(face, request, response);
+        if (!FaceWire::writeResponse(fd, response)) {
+            break;
+        }
+    }
+}
+
+/*
+ * one byte from a worker once it has warmed up, 1 when it is ready and 0
+ * when it could not load its models
+ */
+static bool waitReady(int fd)
+{
+    char ready = 0;
+    ssize_t n;
+    do {
+        n = read(fd, &ready, 1);
+    } while (n < 0 && errno == EINTR);
+    return n == 1 && ready == 1;
+}
+
+/*
+ * forks the worker at index. It drops the parent ends of the other workers,
+ * pins and caps itself, starts OpenBR and sends the byte waitReady reads,
+ * then serves requests until its end is closed. False if it could not be
+ * forked.
+ */
+bool FacePool::forkWorker(int index, Worker &worker)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::cerr << "Failed to create a worker socket pair" << std::endl;
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Failed to fork a face worker" << std::endl;
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        // worker - drop every parent end, including earlier workers'. The
+        // slot being replaced already closed its own, whose number the new
+        // pair may have been given.
+        close(fds[0]);
+        for (size_t j = 0; j < workers.size(); j++) {
+            if ((int)j != index && workers[j].alive) {
+                close(workers[j].fd);
+            }
+        }
+        // the threads OpenBR and OpenCV start from here on inherit the
+        // pinning, and their pools are capped to this worker's share
+        FaceThreads::pinWorker(budget.pinning, index);
+        face->setThreadBudget(budget);
+        // OpenBR starts its thread pool, which fork would not carry over, so
+        // each worker starts its own
+        char ready = face->warmUp() ? 1 : 0;
+        if (write(fds[1], &ready, 1) == 1 && ready == 1) {
+            workerLoop(*face, fds[1]);
+        }
+        // skip the parent's destructors, they are not ours to run
+        _exit(ready == 1 ? 0 : 1);
+    }
+
+    close(fds[1]);
+    worker.pid = pid;
+    worker.fd = fds[0];
+    worker.busy = false;
+    worker.alive = true;
+    return true;
+}
+
+bool FacePool::start(Face &evaluator, const FaceThreads::Budget &threads)
+{
+    stop();
+
+    face = &evaluator;
+    budget = FaceThreads::resolve(threads);
+
+    // the cascades load here, once, and are shared copy-on-write after fork
+    if (!face->warmUpCascades()) {
+        return false;
+    }
+
+    bool failed = false;
+    for (int i = 0; i < budget.workers; i++) {
+        Worker worker;
+        if (!forkWorker(i, worker)) {
+            failed = true;
+            break;
+        }
+        workers.push_back(worker);
+    }
+
+    // the workers warm up side by side, each is waited for in turn
+    for (size_t i = 0; i < workers.size() && !failed; i++) {
+        if (!waitReady(workers[i].fd)) {
+            std::cerr << "A face worker failed to warm up" << std::endl;
+            failed = true;
+        }
+    }
+
+    // a partial pool is torn down, closing and reaping what was forked
+    if (failed || workers.empty()) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void FacePool::stop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    // in flight requests finish first
+    idle.wait(lock, [this]() {
+        for (size_t i = 0; i < workers.size(); i++) {
+            if (workers[i].busy) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    // closing our end is the worker's signal to exit
+    for (size_t i = 0; i < workers.size(); i++) {
+        if (workers[i].alive) {
+            close(workers[i].fd);
+            waitpid(workers[i].pid, NULL, 0);
+        }
+    }
+    workers.clear();
+    idle.notify_all();
+}
+
+int FacePool::size()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int alive = 0;
+    for (size_t i = 0; i < workers.size(); i++) {
+        alive += workers[i].alive ? 1 : 0;
+    }
+    return alive;
+}
+
+bool FacePool::evaluate(const FaceWire::Request &request,
+                        FaceWire::Response &response)
+{
+    size_t index = 0;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        bool found = false;
+        idle.wait(lock, [this, &index, &found]() {
+            bool anyAlive = false;
+            for (size_t i = 0; i < workers.size(); i++) {
+                anyAlive = anyAlive || workers[i].alive;
+                if (workers[i].alive && !workers[i].busy) {
+                    index = i;
+                    found = true;
+                    return true;
+                }
+            }
+            // give up rather than wait forever on a pool with no workers
+            return !anyAlive;
+        });
+        if (!found) {
+            return false;
+        }
+        workers[index].busy = true;
+    }
+
+    bool ok = FaceWire::writeRequest(workers[index].fd, request) &&
+              FaceWire::readResponse(workers[index].fd, response);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!ok) {
+        std::cerr << "Face worker " << workers[index].pid << " died"
+                  << std::endl;
+        close(workers[index].fd);
+        waitpid(workers[index].pid, NULL, 0);
+        workers[index].alive = false;
+
+        // replaced, so crashes cannot drain the pool. The parent has other
+        // threads by now, but none of them holds anything the new worker
+        // takes over: it only reads the loaded cascades and starts OpenBR
+        // afresh. The slot stays busy, and stop() waits, while it warms up.
+        Worker replacement;
+        if (forkWorker((int)index, replacement)) {
+            lock.unlock();
+            bool ready = waitReady(replacement.fd);
+            lock.lock();
+            if (ready) {
+                workers[index] = replacement;
+            }
+            else {
+                std::cerr << "A replacement face worker failed to warm up"
+                          << std::endl;
+                close(replacement.fd);
+                waitpid(replacement.pid, NULL, 0);
+            }
+        }
+    }
+    workers[index].busy = false;
+    idle.notify_all();
+    return ok;
+}
+
+std::vector<FaceWire::Response>
+FacePool::evaluateAll(const std::vector<FaceWire::Request> &requests)
+{
+    // anything left unevaluated (no workers left) reports as failed
+    FaceWire::Response failed;
+    failed.status = FaceWire::FAILED;
+    failed.quality = -1;
+    std::vector<FaceWire::Response> responses(requests.size(), failed);
+    std::mutex nextMutex;
+    size_t next = 0;
+
+    // one feeder thread per worker, each pulling the next request
+    std::vector<std::thread> feeders;
+    int feederCount = size();
+    for (int i = 0; i < feederCount; i++) {
+        feeders.push_back(std::thread([&]() {
+            while (true) {
+                size_t current;
+                {
+                    std::lock_guard<std::mutex> lock(nextMutex);
+                    if (next >= requests.size()) {
+                        return;
+                    }
+                    current = next++;
+                }
+                if (!evaluate(requests[current], responses[current])) {
+                    responses[current] = failed;
+                }
+            }
+        }));
+    }
+    for (size_t i = 0; i < feeders.size(); i++) {
+        feeders[i].join();
+    }
+
+    return responses;
+}
@@ -0,0 +1,65 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "facescratch.h"
+#include <deque>
+
+// the most a slot of a stripe keeps between calls - enough for a stripe of
+// a typical portrait, while the float stripes of a SAP 50 image are
+// allocated for each call rather than held by every pool thread for good.
+// The full frame slots of the evaluating thread, outside any stripe, keep
+// whatever they grow to, so a steady stream of large images allocates none.
+static const size_t keepBytes = 16 << 20;
+
+struct ScratchBuffers {
+    cv::Mat buffers[FaceScratch::SLOT_COUNT];
+};
+
+// the buffers of each nesting level of the calling thread - a deque, so a
+// level entered later does not move the buffers of those below it
+struct ThreadScratch {
+    std::deque<ScratchBuffers> levels;
+    int depth;
+
+    ThreadScratch() : levels(1), depth(0) {}
+};
+
+static ThreadScratch &threadScratch()
+{
+    static thread_local ThreadScratch scratch;
+    return scratch;
+}
+
+FaceScratch::Nesting::Nesting()
+{
+    ThreadScratch &scratch = threadScratch();
+    if (++scratch.depth == (int)scratch.levels.size()) {
+        scratch.levels.push_back(ScratchBuffers());
+    }
+}
+
+FaceScratch::Nesting::~Nesting() { threadScratch().depth--; }
+
+cv::Mat FaceScratch::get(Slot slot, int rows, int cols, int type)
+{
+    size_t bytes = (size_t)rows * cols * CV_ELEM_SIZE(type);
+    ThreadScratch &scratch = threadScratch();
+    if (bytes == 0 || (scratch.depth > 0 && bytes > keepBytes)) {
+        return cv::Mat(rows, cols, type);
+    }
+
+    cv::Mat &buffer = scratch.levels[scratch.depth].buffers[slot];
+    if (buffer.total() < bytes) {
+        // grown to exactly what is asked for - the sizes seen by a thread
+        // rarely vary much
+        buffer.create(1, (int)bytes, CV_8U);
+    }
+    return cv::Mat(rows, cols, type, buffer.data);
+}
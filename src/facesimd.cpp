@@ -0,0 +1,463 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "facesimd.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FACE_SIMD_X86
+#define FACE_SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define FACE_SIMD_INLINE inline
+#endif
+
+// the scalar level is left unvectorized - at -O3 GCC would otherwise use the
+// SSE2 every x86-64 CPU has. Clang has no such attribute and vectorizes it.
+#if defined(__GNUC__) && !defined(__clang__)
+#define FACE_SIMD_SCALAR __attribute__((optimize("no-tree-vectorize")))
+#else
+#define FACE_SIMD_SCALAR
+#endif
+
+/*
+ * the loops every variant is compiled from. They are plain C++ that the
+ * compiler vectorizes for the instruction set of the function they are
+ * inlined into - this file is built with -O3 -fno-math-errno, the latter so
+ * sqrt vectorizes, and -ffp-contract=off, so no level fuses a multiply and
+ * an add the others round twice - and the variants cannot drift apart.
+ * Nothing here may depend on floating point reassociation. The skin lookups
+ * are byte gathers, which no level vectorizes, but they share the dispatch.
+ */
+
+// see FaceMetrics::Optimized::overExposure
+static FACE_SIMD_INLINE int overExposed(int L, int a, int b)
+{
+    int c = L - 40;
+    // & rather than && keeps the loops free of branches
+    return (c > 0) & (c * c > a * a + b * b);
+}
+
+// the same test on float Lab, scaled to the 8-bit encoding it is defined on
+static FACE_SIMD_INLINE int overExposed(float L, float a, float b)
+{
+    float c = L * (255.f / 100.f) - 40;
+    float a8 = a + 128, b8 = b + 128;
+    return (c > 0) & (c * c > a8 * a8 + b8 * b8);
+}
+
+template <typename T>
+static FACE_SIMD_INLINE long overExposedPixelsLoop(const T *lab, int count)
+{
+    // an int sum vectorizes, and a row count fits
+    int bad = 0;
+    for (int i = 0; i < count; i++) {
+        bad += overExposed(lab[3 * i], lab[3 * i + 1], lab[3 * i + 2]);
+    }
+    return bad;
+}
+
+static FACE_SIMD_INLINE void overExposedMaskLoop(const uint8_t *__restrict lab,
+                                                 uint8_t *__restrict mask,
+                                                 int count)
+{
+    for (int i = 0; i < count; i++) {
+        mask[i] = overExposed(lab[3 * i], lab[3 * i + 1], lab[3 * i + 2]);
+    }
+}
+
+/*
+ * cvtColor's BGR2GRAY and BGR2YCrCb for 8-bit images as of OpenCV 4: fixed
+ * point with rounding, 15 bits for gray and 14 for the luma and the chroma
+ * (offset by 128 and saturated) of YCrCb. FaceMetrics::convert checks these
+ * against cvtColor before it relies on them.
+ */
+enum {
+    GRAY_SHIFT = 15,
+    GRAY_B = 3735,
+    GRAY_G = 19235,
+    GRAY_R = 9798,
+    YUV_SHIFT = 14,
+    B2Y = 1868,
+    G2Y = 9617,
+    R2Y = 4899,
+    CR2Y = 11682,
+    CB2Y = 9241,
+    CHROMA_DELTA = (128 << YUV_SHIFT) + (1 << (YUV_SHIFT - 1)),
+    // a 16-bit chroma is rounded to 8-bit units once, offset by 128 of them
+    UNIT16 = 257 << YUV_SHIFT,
+    CHROMA16_DELTA = 128 * UNIT16 + UNIT16 / 2
+};
+
+static FACE_SIMD_INLINE int grayOf(int b, int g, int r)
+{
+    return (b * GRAY_B + g * GRAY_G + r * GRAY_R + (1 << (GRAY_SHIFT - 1))) >>
+           GRAY_SHIFT;
+}
+
+// fits an int for 16-bit channels too, the coefficients add up to 1 << 14
+static FACE_SIMD_INLINE int luma(int b, int g, int r)
+{
+    return (b * B2Y + g * G2Y + r * R2Y + (1 << (YUV_SHIFT - 1))) >> YUV_SHIFT;
+}
+
+static FACE_SIMD_INLINE int saturate(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+/*
+ * what the kernels of one depth need to know about it. A 16-bit channel is
+ * measured in 8-bit units (of 257), so the thresholds and the results of
+ * the metrics keep their meaning.
+ */
+template <typename T> struct Pixel;
+
+template <> struct Pixel<uint8_t> {
+    // holds a sum of squared channel differences exactly
+    typedef int Sum;
+
+    static FACE_SIMD_INLINE double unit() { return 1; }
+
+    static FACE_SIMD_INLINE int chroma(int c, int y, int coefficient)
+    {
+        return saturate(((c - y) * coefficient + CHROMA_DELTA) >> YUV_SHIFT);
+    }
+};
+
+template <> struct Pixel<uint16_t> {
+    typedef double Sum;
+
+    static FACE_SIMD_INLINE double unit() { return 257; }
+
+    // at most 1.31e9, and truncation towards 0 only affects what saturates
+    static FACE_SIMD_INLINE int chroma(int c, int y, int coefficient)
+    {
+        return saturate(((c - y) * coefficient + CHROMA16_DELTA) / UNIT16);
+    }
+};
+
+/*
+ * the distance is taken over the first three channels, so the alpha of a
+ * BGRA image is left out
+ */
+template <typename T, int CN>
+static FACE_SIMD_INLINE int blurDifferenceLoop(const T *p0, const T *p1,
+                                               const T *p2, int count,
+                                               int threshold)
+{
+    typedef typename Pixel<T>::Sum Sum;
+    const int colors = CN < 3 ? CN : 3;
+    int difference = 0;
+    for (int i = 0; i < count * CN; i += CN) {
+        Sum d01 = 0, d12 = 0;
+        for (int c = 0; c < colors; c++) {
+            Sum a = (Sum)p0[i + c] - (Sum)p1[i + c];
+            Sum b = (Sum)p1[i + c] - (Sum)p2[i + c];
+            d01 += a * a;
+            d12 += b * b;
+        }
+        int diff = (int)(std::fabs(std::sqrt((double)d01) -
+                                   std::sqrt((double)d12)) /
+                         Pixel<T>::unit());
+        difference += diff > threshold ? diff : 0;
+    }
+    return difference;
+}
+
+static FACE_SIMD_INLINE void skinLookupLoop(const uint8_t *__restrict ycrcb,
+                                            uint8_t *__restrict mask,
+                                            int count, const uint8_t *table)
+{
+    for (int i = 0; i < count; i++) {
+        mask[i] = table[ycrcb[3 * i + 1] * 256 + ycrcb[3 * i + 2]];
+    }
+}
+
+static FACE_SIMD_INLINE void grayLoop(const uint8_t *__restrict bgr,
+                                      uint8_t *__restrict gray, int count)
+{
+    for (int i = 0; i < count; i++) {
+        gray[i] = grayOf(bgr[3 * i], bgr[3 * i + 1], bgr[3 * i + 2]);
+    }
+}
+
+/*
+ * the lookup is a gather, so the chroma of a chunk is computed first. A gray
+ * pixel is its own luma and has the neutral chroma. Only 8-bit BGR comes
+ * with gray.
+ */
+template <typename T, int CN, bool GRAY>
+static FACE_SIMD_INLINE void skinLoop(const T *__restrict pixels,
+                                      uint8_t *__restrict gray,
+                                      uint8_t *__restrict skin, int count,
+                                      const uint8_t *table)
+{
+    const int chunk = 256;
+    uint16_t index[chunk];
+    for (int start = 0; start < count; start += chunk) {
+        int n = count - start < chunk ? count - start : chunk;
+        const T *p = pixels + CN * start;
+        for (int i = 0; i < n; i++) {
+            int b = p[CN * i];
+            int g = CN == 1 ? b : p[CN * i + 1];
+            int r = CN == 1 ? b : p[CN * i + 2];
+            int y = luma(b, g, r);
+            if (GRAY) {
+                gray[start + i] = grayOf(b, g, r);
+            }
+            index[i] = Pixel<T>::chroma(r, y, CR2Y) * 256 +
+                       Pixel<T>::chroma(b, y, CB2Y);
+        }
+        for (int i = 0; i < n; i++) {
+            skin[start + i] = table[index[i]];
+        }
+    }
+}
+
+static FACE_SIMD_INLINE void grayAndSkinLoop(const uint8_t *bgr,
+                                             uint8_t *gray, uint8_t *skin,
+                                             int count, const uint8_t *table)
+{
+    if (skin == NULL) {
+        if (gray != NULL) {
+            grayLoop(bgr, gray, count);
+        }
+    }
+    else if (gray == NULL) {
+        skinLoop<uint8_t, 3, false>(bgr, gray, skin, count, table);
+    }
+    else {
+        skinLoop<uint8_t, 3, true>(bgr, gray, skin, count, table);
+    }
+}
+
+// the kernels of one level, compiled for the given target attribute
+#define FACE_SIMD_VARIANT(suffix, target)                                      \
+    static target long overExposedPixels##suffix(const uint8_t *lab,           \
+                                                  int count)                   \
+    {                                                                          \
+        return overExposedPixelsLoop(lab, count);                              \
+    }                                                                          \
+    static target long overExposedPixelsFloat##suffix(const float *lab,        \
+                                                       int count)              \
+    {                                                                          \
+        return overExposedPixelsLoop(lab, count);                              \
+    }                                                                          \
+    template <typename T, int CN>                                              \
+    static target int blurDifference##suffix(const void *p0, const void *p1,   \
+                                             const void *p2, int count,        \
+                                             int threshold)                    \
+    {                                                                          \
+        return blurDifferenceLoop<T, CN>((const T *)p0, (const T *)p1,         \
+                                         (const T *)p2, count, threshold);     \
+    }                                                                          \
+    static target void skinLookup##suffix(const uint8_t *ycrcb, uint8_t *mask, \
+                                          int count, const uint8_t *table)     \
+    {                                                                          \
+        skinLookupLoop(ycrcb, mask, count, table);                             \
+    }                                                                          \
+    template <typename T, int CN>                                              \
+    static target void skinMask##suffix(const void *pixels, uint8_t *mask,     \
+                                        int count, const uint8_t *table)       \
+    {                                                                          \
+        skinLoop<T, CN, false>((const T *)pixels, NULL, mask, count, table);   \
+    }                                                                          \
+    static target void overExposedMask##suffix(const uint8_t *lab,             \
+                                               uint8_t *mask, int count)       \
+    {                                                                          \
+        overExposedMaskLoop(lab, mask, count);                                 \
+    }                                                                          \
+    static target void grayAndSkin##suffix(const uint8_t *bgr, uint8_t *gray,  \
+                                           uint8_t *skin, int count,           \
+                                           const uint8_t *table)               \
+    {                                                                          \
+        grayAndSkinLoop(bgr, gray, skin, count, table);                        \
+    }
+
+FACE_SIMD_VARIANT(Scalar, FACE_SIMD_SCALAR)
+#ifdef FACE_SIMD_X86
+FACE_SIMD_VARIANT(Sse42, __attribute__((target("sse4.2"))))
+FACE_SIMD_VARIANT(Avx2, __attribute__((target("avx2"))))
+FACE_SIMD_VARIANT(Avx512, __attribute__((target("avx512f,avx512bw"))))
+#endif
+
+namespace {
+
+// the format kernels are indexed by depth and channel count
+struct Kernels {
+    long (*overExposedPixels)(const uint8_t *, int);
+    long (*overExposedPixelsFloat)(const float *, int);
+    FaceSimd::BlurDifference blurDifference[FaceSimd::DEPTH_COUNT][5];
+    void (*skinLookup)(const uint8_t *, uint8_t *, int, const uint8_t *);
+    FaceSimd::SkinMask skinMask[FaceSimd::DEPTH_COUNT][5];
+    void (*overExposedMask)(const uint8_t *, uint8_t *, int);
+    void (*grayAndSkin)(const uint8_t *, uint8_t *, uint8_t *, int,
+                        const uint8_t *);
+};
+
+} // namespace
+
+#define FACE_SIMD_BLUR_FORMATS(suffix, T)                                      \
+    {                                                                          \
+        NULL, blurDifference##suffix<T, 1>, blurDifference##suffix<T, 2>,      \
+            blurDifference##suffix<T, 3>, blurDifference##suffix<T, 4>         \
+    }
+
+#define FACE_SIMD_SKIN_FORMATS(suffix, T)                                      \
+    {                                                                          \
+        NULL, skinMask##suffix<T, 1>, NULL, skinMask##suffix<T, 3>,            \
+            skinMask##suffix<T, 4>                                             \
+    }
+
+#define FACE_SIMD_KERNELS(suffix)                                              \
+    {                                                                          \
+        overExposedPixels##suffix, overExposedPixelsFloat##suffix,             \
+            {FACE_SIMD_BLUR_FORMATS(suffix, uint8_t),                          \
+             FACE_SIMD_BLUR_FORMATS(suffix, uint16_t)},                        \
+            skinLookup##suffix,                                                \
+            {FACE_SIMD_SKIN_FORMATS(suffix, uint8_t),                          \
+             FACE_SIMD_SKIN_FORMATS(suffix, uint16_t)},                        \
+            overExposedMask##suffix, grayAndSkin##suffix                       \
+    }
+
+static const Kernels kernels[FaceSimd::LEVEL_COUNT] = {
+#ifdef FACE_SIMD_X86
+    FACE_SIMD_KERNELS(Scalar), FACE_SIMD_KERNELS(Sse42),
+    FACE_SIMD_KERNELS(Avx2), FACE_SIMD_KERNELS(Avx512)
+#else
+    FACE_SIMD_KERNELS(Scalar), FACE_SIMD_KERNELS(Scalar),
+    FACE_SIMD_KERNELS(Scalar), FACE_SIMD_KERNELS(Scalar)
+#endif
+};
+
+static const char *levelNames[FaceSimd::LEVEL_COUNT] = {"scalar", "sse4.2",
+                                                        "avx2", "avx512"};
+
+FaceSimd::Level FaceSimd::detected()
+{
+#ifdef FACE_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512bw")) {
+        return AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return SSE42;
+    }
+#endif
+    return SCALAR;
+}
+
+// the detected level unless BIQT_FACE_SIMD asks for a supported lower one
+static FaceSimd::Level initialLevel()
+{
+    FaceSimd::Level best = FaceSimd::detected();
+    const char *forced = getenv("BIQT_FACE_SIMD");
+    if (forced == NULL) {
+        return best;
+    }
+
+    FaceSimd::Level level;
+    if (!FaceSimd::parseLevel(forced, level)) {
+        std::cerr << "Ignoring BIQT_FACE_SIMD=" << forced
+                  << ", expected scalar, sse4.2, avx2 or avx512" << std::endl;
+        return best;
+    }
+    if (level > best) {
+        std::cerr << "BIQT_FACE_SIMD=" << forced
+                  << " is not supported by this CPU, using "
+                  << FaceSimd::name(best) << std::endl;
+        return best;
+    }
+    return level;
+}
+
+static std::atomic<int> currentLevel(initialLevel());
+
+FaceSimd::Level FaceSimd::level()
+{
+    return (Level)currentLevel.load(std::memory_order_relaxed);
+}
+
+bool FaceSimd::setLevel(Level level)
+{
+    if (level < SCALAR || level > detected()) {
+        return false;
+    }
+    currentLevel = level;
+    return true;
+}
+
+const char *FaceSimd::name(Level level)
+{
+    return level >= SCALAR && level < LEVEL_COUNT ? levelNames[level] : "";
+}
+
+bool FaceSimd::parseLevel(const char *name, Level &level)
+{
+    for (int i = 0; i < LEVEL_COUNT; i++) {
+        if (strcmp(name, levelNames[i]) == 0) {
+            level = (Level)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+long FaceSimd::overExposedPixels(const uint8_t *lab, int count)
+{
+    return kernels[level()].overExposedPixels(lab, count);
+}
+
+long FaceSimd::overExposedPixels(const float *lab, int count)
+{
+    return kernels[level()].overExposedPixelsFloat(lab, count);
+}
+
+FaceSimd::BlurDifference FaceSimd::blurDifference(Depth depth, int cn)
+{
+    if (depth < DEPTH_8U || depth >= DEPTH_COUNT || cn < 1 || cn > 4) {
+        return NULL;
+    }
+    return kernels[level()].blurDifference[depth][cn];
+}
+
+void FaceSimd::skinLookup(const uint8_t *ycrcb, uint8_t *mask, int count,
+                          const uint8_t *table)
+{
+    kernels[level()].skinLookup(ycrcb, mask, count, table);
+}
+
+FaceSimd::SkinMask FaceSimd::skinMask(Depth depth, int cn)
+{
+    if (depth < DEPTH_8U || depth >= DEPTH_COUNT || cn < 1 || cn > 4) {
+        return NULL;
+    }
+    return kernels[level()].skinMask[depth][cn];
+}
+
+void FaceSimd::overExposedMask(const uint8_t *lab, uint8_t *mask, int count)
+{
+    kernels[level()].overExposedMask(lab, mask, count);
+}
+
+void FaceSimd::grayAndSkin(const uint8_t *bgr, uint8_t *gray, uint8_t *skin,
+                           int count, const uint8_t *table)
+{
+    kernels[level()].grayAndSkin(bgr, gray, skin, count, table);
+}
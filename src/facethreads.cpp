@@ -0,0 +1,242 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "facethreads.h"
+#include "opencv2/core/core.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+std::vector<int> FaceThreads::allowedCpus()
+{
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        int count = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < count; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// the cgroup (v2 unified or v1 cpu controller) path of this process
+static std::string cgroupPath(bool unified)
+{
+    std::ifstream in("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(in, line)) {
+        // hierarchy-ID:controller-list:path
+        size_t first = line.find(':');
+        size_t second = line.find(':', first + 1);
+        if (first == std::string::npos || second == std::string::npos) {
+            continue;
+        }
+        std::string controllers = line.substr(first + 1, second - first - 1);
+        std::stringstream list(controllers);
+        std::string controller;
+        bool cpu = false;
+        while (std::getline(list, controller, ',')) {
+            cpu = cpu || controller == "cpu";
+        }
+        if ((unified && controllers.empty()) || (!unified && cpu)) {
+            return line.substr(second + 1);
+        }
+    }
+    return "";
+}
+
+/*
+ * the CPUs the cgroup quota allows, 0 without one. Inside a container the
+ * cgroup of the process is usually mounted as the root, so the root files
+ * are read when the path of the process does not exist.
+ */
+static int quotaCpus()
+{
+    double quota = -1, period = 0;
+
+    std::string path = cgroupPath(true);
+    std::ifstream max("/sys/fs/cgroup" + path + "/cpu.max");
+    if (!max) {
+        max.open("/sys/fs/cgroup/cpu.max");
+    }
+    std::string limit;
+    if (max >> limit >> period) {
+        quota = limit == "max" ? -1 : atof(limit.c_str());
+    }
+    else {
+        const char *roots[] = {"/sys/fs/cgroup/cpu",
+                               "/sys/fs/cgroup/cpu,cpuacct"};
+        path = cgroupPath(false);
+        for (int i = 0; i < 2 && period <= 0; i++) {
+            std::ifstream quotaFile(roots[i] + path + "/cpu.cfs_quota_us");
+            std::ifstream periodFile(roots[i] + path + "/cpu.cfs_period_us");
+            if (!quotaFile) {
+                quotaFile.open(std::string(roots[i]) + "/cpu.cfs_quota_us");
+                periodFile.open(std::string(roots[i]) + "/cpu.cfs_period_us");
+            }
+            if (!(quotaFile >> quota && periodFile >> period)) {
+                quota = -1;
+                period = 0;
+            }
+        }
+    }
+
+    if (quota <= 0 || period <= 0) {
+        return 0;
+    }
+    return std::max(1, (int)((quota + period - 1) / period));
+}
+
+int FaceThreads::availableCpus()
+{
+    int cpus = (int)allowedCpus().size();
+    int quota = quotaCpus();
+    return quota > 0 ? std::min(cpus, quota) : cpus;
+}
+
+FaceThreads::Budget FaceThreads::resolve(const Budget &budget)
+{
+    Budget resolved = budget;
+    int cpus = availableCpus();
+    resolved.threadsPerWorker = std::max(0, resolved.threadsPerWorker);
+    if (resolved.workers <= 0) {
+        // as many as the threads per worker leave room for
+        resolved.workers = resolved.threadsPerWorker > 0
+                               ? std::max(1, cpus / resolved.threadsPerWorker)
+                               : cpus;
+    }
+    else if (resolved.threadsPerWorker == 0) {
+        // the workers share the CPUs rather than each running default pools
+        resolved.threadsPerWorker = std::max(1, cpus / resolved.workers);
+    }
+    // with neither set the threads per worker stay 0 - pinning alone is no
+    // reason to shrink the pools
+    return resolved;
+}
+
+void FaceThreads::apply(const Budget &resolved)
+{
+    if (resolved.threadsPerWorker > 0) {
+        cv::setNumThreads(resolved.threadsPerWorker);
+    }
+}
+
+// the CPUs of a cpulist such as "0-3,8,10-11"
+static std::vector<int> parseCpuList(const std::string &text)
+{
+    std::vector<int> cpus;
+    std::stringstream list(text);
+    std::string range;
+    while (std::getline(list, range, ',')) {
+        int first, last;
+        char dash;
+        std::stringstream in(range);
+        if (!(in >> first)) {
+            continue;
+        }
+        if (!(in >> dash >> last)) {
+            last = first;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// the allowed CPUs of each NUMA node that has any
+static std::vector<std::vector<int>> numaNodes(const std::vector<int> &allowed)
+{
+    std::vector<std::vector<int>> nodes;
+    for (int node = 0;; node++) {
+        std::ifstream in("/sys/devices/system/node/node" +
+                         std::to_string(node) + "/cpulist");
+        std::string text;
+        if (!std::getline(in, text)) {
+            break;
+        }
+        std::vector<int> cpus = parseCpuList(text), usable;
+        for (size_t i = 0; i < cpus.size(); i++) {
+            if (std::find(allowed.begin(), allowed.end(), cpus[i]) !=
+                allowed.end()) {
+                usable.push_back(cpus[i]);
+            }
+        }
+        if (!usable.empty()) {
+            nodes.push_back(usable);
+        }
+    }
+    return nodes;
+}
+
+bool FaceThreads::pinWorker(Pinning pinning, int index)
+{
+    if (pinning == NO_PINNING) {
+        return true;
+    }
+#ifdef __linux__
+    std::vector<int> allowed = allowedCpus();
+    std::vector<int> cpus;
+    if (pinning == PIN_CORES) {
+        cpus.push_back(allowed[index % allowed.size()]);
+    }
+    else {
+        std::vector<std::vector<int>> nodes = numaNodes(allowed);
+        if (nodes.empty()) {
+            return false;
+        }
+        cpus = nodes[index % nodes.size()];
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); i++) {
+        CPU_SET(cpus[i], &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+bool FaceThreads::parsePinning(const std::string &name, Pinning &pinning)
+{
+    if (name == "none") {
+        pinning = NO_PINNING;
+    }
+    else if (name == "cores") {
+        pinning = PIN_CORES;
+    }
+    else if (name == "numa") {
+        pinning = PIN_NUMA_NODES;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
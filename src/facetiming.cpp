@@ -0,0 +1,318 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "facetiming.h"
+#include "facetrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <time.h>
+
+static const char *stageNames[FaceTiming::STAGE_COUNT] = {
+    "imread",
+    "imdecode",
+    "gray",
+    "convertPlanes",
+    "detectMultiScale:haar face",
+    "detectMultiScale:haar profile face",
+    "detectMultiScale:lbp face",
+    "detectMultiScale:eye pair",
+    "detectMultiScale:left eye",
+    "detectMultiScale:right eye",
+    "detectMultiScale:nose",
+    "detectMultiScale:mouth",
+    "registerImage",
+    "setFace",
+    "setSAPLevel",
+    "setCvNumLandmarks",
+    "setEyeCount",
+    "setNoseCount",
+    "setMouthCount",
+    "setOpenBrMetrics",
+    "setSkinFull",
+    "setFaceOffset",
+    "setFocus",
+    "setOverExposure",
+    "setBlur",
+    "setBackground"};
+
+/*
+ * the counters of one thread. Only the owning thread writes them, snapshot
+ * reads them from any thread - hence relaxed atomics rather than a lock.
+ */
+struct ThreadStats {
+    std::atomic<uint64_t> count[FaceTiming::STAGE_COUNT];
+    std::atomic<uint64_t> wallNs[FaceTiming::STAGE_COUNT];
+    std::atomic<uint64_t> cpuNs[FaceTiming::STAGE_COUNT];
+    std::atomic<uint64_t> maxWallNs[FaceTiming::STAGE_COUNT];
+    std::atomic<uint64_t> histogram[FaceTiming::STAGE_COUNT]
+                                   [FaceTiming::HISTOGRAM_BUCKETS];
+
+    ThreadStats() { clear(); }
+
+    void clear()
+    {
+        for (int i = 0; i < FaceTiming::STAGE_COUNT; i++) {
+            count[i].store(0, std::memory_order_relaxed);
+            wallNs[i].store(0, std::memory_order_relaxed);
+            cpuNs[i].store(0, std::memory_order_relaxed);
+            maxWallNs[i].store(0, std::memory_order_relaxed);
+            for (int j = 0; j < FaceTiming::HISTOGRAM_BUCKETS; j++) {
+                histogram[i][j].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// unlike ThreadStats written by every thread working on the image
+struct FaceTiming::ImageTimes {
+    std::atomic<uint64_t> wallNs[STAGE_COUNT];
+
+    ImageTimes()
+    {
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            wallNs[i].store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+static std::atomic<bool> timingEnabled(false);
+
+// every live thread that has timed something, and the totals of the ones
+// that have exited
+static std::mutex registryMutex;
+static std::vector<ThreadStats *> registry;
+static uint64_t retired[FaceTiming::STAGE_COUNT][4];
+static uint64_t retiredHistogram[FaceTiming::STAGE_COUNT]
+                                [FaceTiming::HISTOGRAM_BUCKETS];
+
+static void add(std::atomic<uint64_t> &counter, uint64_t value)
+{
+    // single writer - no need for a locked add
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+}
+
+struct ThreadStatsHolder {
+    ThreadStats *stats;
+
+    ThreadStatsHolder() : stats(new ThreadStats())
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(stats);
+    }
+
+    ~ThreadStatsHolder()
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (int i = 0; i < FaceTiming::STAGE_COUNT; i++) {
+            retired[i][0] += stats->count[i].load(std::memory_order_relaxed);
+            retired[i][1] += stats->wallNs[i].load(std::memory_order_relaxed);
+            retired[i][2] += stats->cpuNs[i].load(std::memory_order_relaxed);
+            retired[i][3] =
+                std::max(retired[i][3],
+                         stats->maxWallNs[i].load(std::memory_order_relaxed));
+            for (int j = 0; j < FaceTiming::HISTOGRAM_BUCKETS; j++) {
+                retiredHistogram[i][j] +=
+                    stats->histogram[i][j].load(std::memory_order_relaxed);
+            }
+        }
+        registry.erase(std::find(registry.begin(), registry.end(), stats));
+        delete stats;
+    }
+};
+
+static ThreadStats &threadStats()
+{
+    static thread_local ThreadStatsHolder holder;
+    return *holder.stats;
+}
+
+static FaceTiming::ImageContext &threadImage()
+{
+    static thread_local FaceTiming::ImageContext image;
+    return image;
+}
+
+static uint64_t wallNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static uint64_t cpuNow()
+{
+    struct timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) {
+        return 0;
+    }
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int bucketOf(uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    if (us == 0) {
+        return 0;
+    }
+    int bucket = 63 - __builtin_clzll(us);
+    return std::min(bucket, FaceTiming::HISTOGRAM_BUCKETS - 1);
+}
+
+double FaceTiming::StageStats::wallPercentile(double fraction) const
+{
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(fraction * count);
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen > target || seen == count) {
+            return std::min((double)(2ULL << i) / 1e6, maxWallSeconds);
+        }
+    }
+    return maxWallSeconds;
+}
+
+const char *FaceTiming::stageName(Stage stage) { return stageNames[stage]; }
+
+FaceTiming::Stage FaceTiming::cascadeStage(int cascade)
+{
+    return (Stage)(DETECT_HAAR_FACE + cascade);
+}
+
+void FaceTiming::setEnabled(bool enabled) { timingEnabled = enabled; }
+
+bool FaceTiming::isEnabled()
+{
+    return timingEnabled.load(std::memory_order_relaxed);
+}
+
+void FaceTiming::snapshot(std::vector<StageStats> &stats)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    stats.resize(STAGE_COUNT);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        uint64_t count = retired[i][0];
+        uint64_t wallNs = retired[i][1];
+        uint64_t cpuNs = retired[i][2];
+        uint64_t maxWallNs = retired[i][3];
+        for (int j = 0; j < HISTOGRAM_BUCKETS; j++) {
+            stats[i].histogram[j] = retiredHistogram[i][j];
+        }
+
+        for (unsigned int t = 0; t < registry.size(); t++) {
+            const ThreadStats &thread = *registry[t];
+            count += thread.count[i].load(std::memory_order_relaxed);
+            wallNs += thread.wallNs[i].load(std::memory_order_relaxed);
+            cpuNs += thread.cpuNs[i].load(std::memory_order_relaxed);
+            maxWallNs = std::max(
+                maxWallNs, thread.maxWallNs[i].load(std::memory_order_relaxed));
+            for (int j = 0; j < HISTOGRAM_BUCKETS; j++) {
+                stats[i].histogram[j] +=
+                    thread.histogram[i][j].load(std::memory_order_relaxed);
+            }
+        }
+
+        stats[i].count = count;
+        stats[i].wallSeconds = wallNs / 1e9;
+        stats[i].cpuSeconds = cpuNs / 1e9;
+        stats[i].maxWallSeconds = maxWallNs / 1e9;
+    }
+}
+
+void FaceTiming::reset()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        for (int j = 0; j < 4; j++) {
+            retired[i][j] = 0;
+        }
+        for (int j = 0; j < HISTOGRAM_BUCKETS; j++) {
+            retiredHistogram[i][j] = 0;
+        }
+    }
+    for (unsigned int t = 0; t < registry.size(); t++) {
+        registry[t]->clear();
+    }
+}
+
+void FaceTiming::beginImage()
+{
+    // a new one rather than cleared, so a helper thread still running for
+    // the previous image (a cancelled speculation) does not add to this one
+    threadImage() = std::make_shared<ImageTimes>();
+}
+
+void FaceTiming::imageTimes(std::map<std::string, double> &times)
+{
+    const ImageContext &image = threadImage();
+    if (!image) {
+        return;
+    }
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        uint64_t wallNs = image->wallNs[i].load(std::memory_order_relaxed);
+        if (wallNs > 0) {
+            times[stageNames[i]] = wallNs / 1e9;
+        }
+    }
+}
+
+FaceTiming::ImageContext FaceTiming::currentImage() { return threadImage(); }
+
+void FaceTiming::setCurrentImage(const ImageContext &image)
+{
+    threadImage() = image;
+}
+
+FaceTiming::Timer::Timer(Stage stage)
+    : stage(stage), running(isEnabled()), tracing(FaceTrace::isEnabled()),
+      wallStart(0), cpuStart(0)
+{
+    if (running || tracing) {
+        wallStart = wallNow();
+    }
+    if (running) {
+        cpuStart = cpuNow();
+    }
+}
+
+FaceTiming::Timer::~Timer()
+{
+    if (!running && !tracing) {
+        return;
+    }
+
+    uint64_t wall = wallNow() - wallStart;
+    if (tracing) {
+        FaceTrace::record(stageNames[stage], wallStart, wall);
+    }
+    if (!running) {
+        return;
+    }
+
+    uint64_t cpu = cpuNow() - cpuStart;
+    ThreadStats &stats = threadStats();
+    add(stats.count[stage], 1);
+    add(stats.wallNs[stage], wall);
+    add(stats.cpuNs[stage], cpu);
+    if (wall > stats.maxWallNs[stage].load(std::memory_order_relaxed)) {
+        stats.maxWallNs[stage].store(wall, std::memory_order_relaxed);
+    }
+    add(stats.histogram[stage][bucketOf(wall)], 1);
+    const ImageContext &image = threadImage();
+    if (image) {
+        image->wallNs[stage].fetch_add(wall, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,280 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "facetrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+struct Event {
+    const char *name;
+    uint64_t startNs;
+    uint64_t durationNs;
+    uint32_t image;
+    uint32_t tid;
+};
+
+struct TraceBuffer {
+    // only contended while stop() drains the buffer
+    std::mutex mutex;
+    std::vector<Event> events;
+    uint32_t tid;
+    uint32_t image;
+};
+
+} // namespace
+
+static std::atomic<bool> tracing(false);
+// set by start(), read by record() to clamp spans begun before it
+static std::atomic<uint64_t> traceStartNs(0);
+
+// spans and images kept per trace, about 32 MB of events; past it they are
+// counted as dropped so a long run cannot grow the buffers without bound
+static const long maxEvents = 1 << 20;
+static std::atomic<long> recorded(0);
+static std::atomic<long> dropped(0);
+
+// guards everything below
+static std::mutex traceMutex;
+static std::string tracePath;
+static std::vector<TraceBuffer *> buffers;
+// the events of threads that have exited
+static std::vector<Event> finished;
+// image identifiers, index 0 is "no image"
+static std::vector<std::string> images;
+
+static uint64_t wallNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static uint32_t threadId()
+{
+#ifdef __linux__
+    return (uint32_t)syscall(SYS_gettid);
+#else
+    static std::atomic<uint32_t> next(1);
+    return next++;
+#endif
+}
+
+struct TraceBufferHolder {
+    TraceBuffer *buffer;
+
+    TraceBufferHolder() : buffer(new TraceBuffer())
+    {
+        buffer->tid = threadId();
+        buffer->image = 0;
+        std::lock_guard<std::mutex> lock(traceMutex);
+        buffers.push_back(buffer);
+    }
+
+    ~TraceBufferHolder()
+    {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        finished.insert(finished.end(), buffer->events.begin(),
+                        buffer->events.end());
+        buffers.erase(std::find(buffers.begin(), buffers.end(), buffer));
+        delete buffer;
+    }
+};
+
+static TraceBuffer &threadBuffer()
+{
+    static thread_local TraceBufferHolder holder;
+    return *holder.buffer;
+}
+
+static void writeString(std::ostream &out, const std::string &value)
+{
+    out << '"';
+    for (size_t i = 0; i < value.size(); i++) {
+        unsigned char c = value[i];
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        }
+        else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        }
+        else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+bool FaceTrace::start(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (tracing) {
+        return false;
+    }
+
+    tracePath = path;
+    traceStartNs = wallNow();
+    recorded = 0;
+    dropped = 0;
+    finished.clear();
+    images.assign(1, "");
+    for (unsigned int i = 0; i < buffers.size(); i++) {
+        std::lock_guard<std::mutex> bufferLock(buffers[i]->mutex);
+        buffers[i]->events.clear();
+    }
+    tracing = true;
+    return true;
+}
+
+bool FaceTrace::stop()
+{
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (!tracing) {
+        return false;
+    }
+    tracing = false;
+
+    std::vector<Event> events;
+    events.swap(finished);
+    for (unsigned int i = 0; i < buffers.size(); i++) {
+        std::lock_guard<std::mutex> bufferLock(buffers[i]->mutex);
+        events.insert(events.end(), buffers[i]->events.begin(),
+                      buffers[i]->events.end());
+        buffers[i]->events.clear();
+    }
+
+    if (dropped > 0) {
+        std::cerr << "The trace dropped " << dropped
+                  << " spans past its limit of " << maxEvents << std::endl;
+    }
+
+    std::ofstream out(tracePath.c_str());
+    if (!out) {
+        std::cerr << "Failed to write the trace to " << tracePath << std::endl;
+        return false;
+    }
+
+    int pid = getpid();
+    uint64_t traceStart = traceStartNs;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+        << ",\"args\":{\"name\":\"BIQTFace\"}}";
+    for (unsigned int i = 0; i < events.size(); i++) {
+        const Event &event = events[i];
+        out << ",\n{\"name\":";
+        writeString(out, event.name);
+        out << ",\"cat\":\""
+            << (strcmp(event.name, "image") == 0 ? "image" : "stage")
+            << "\",\"ph\":\"X\",\"ts\":"
+            << (event.startNs - std::min(event.startNs, traceStart)) / 1000.0
+            << ",\"dur\":" << event.durationNs / 1000.0 << ",\"pid\":" << pid
+            << ",\"tid\":" << event.tid;
+        if (event.image > 0 && event.image < images.size()) {
+            out << ",\"args\":{\"image\":";
+            writeString(out, images[event.image]);
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n]}\n";
+    return out.good();
+}
+
+bool FaceTrace::isEnabled() { return tracing.load(std::memory_order_relaxed); }
+
+// takes a slot of the budget, or counts what is dropped
+static bool reserve()
+{
+    if (recorded.fetch_add(1, std::memory_order_relaxed) < maxEvents) {
+        return true;
+    }
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+FaceTrace::ImageSpan::ImageSpan(const std::string &name)
+    : image(0), previous(0), start(0)
+{
+    if (!isEnabled() || !reserve()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        images.push_back(name);
+        image = images.size() - 1;
+    }
+    previous = currentImage();
+    setCurrentImage(image);
+    start = wallNow();
+}
+
+FaceTrace::ImageSpan::~ImageSpan()
+{
+    if (image == 0) {
+        return;
+    }
+    record("image", start, wallNow() - start);
+    setCurrentImage(previous);
+}
+
+uint32_t FaceTrace::currentImage() { return threadBuffer().image; }
+
+void FaceTrace::setCurrentImage(uint32_t image)
+{
+    threadBuffer().image = image;
+}
+
+void FaceTrace::record(const char *name, uint64_t startNs, uint64_t durationNs)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    // a span begun before start() is cut to the part inside the trace
+    uint64_t traceStart = traceStartNs.load(std::memory_order_relaxed);
+    if (startNs < traceStart) {
+        uint64_t before = traceStart - startNs;
+        if (durationNs <= before) {
+            return;
+        }
+        durationNs -= before;
+        startNs = traceStart;
+    }
+    if (!reserve()) {
+        return;
+    }
+
+    TraceBuffer &buffer = threadBuffer();
+    Event event;
+    event.name = name;
+    event.startNs = startNs;
+    event.durationNs = durationNs;
+    event.image = buffer.image;
+    event.tid = buffer.tid;
+
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events.push_back(event);
+}
@@ -0,0 +1,96 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "facetracker.h"
+#include "opencv2/imgproc/imgproc.hpp"
+
+// the template is matched at this width, whatever the face size
+static const int templateWidth = 48;
+// how far (in face widths/heights) the face may move between frames
+static const double searchMargin = 0.5;
+// the template follows slow appearance changes when the match is this good
+static const double refreshConfidence = 0.8;
+
+FaceTracker::FaceTracker() : tracking(false), scale(1.0) {}
+
+void FaceTracker::reset()
+{
+    tracking = false;
+    faceTemplate.release();
+}
+
+bool FaceTracker::isTracking() const { return tracking; }
+
+cv::Mat FaceTracker::scaled(const cv::Mat &gray, const cv::Rect &region) const
+{
+    cv::Mat result;
+    cv::resize(gray(region), result,
+               cv::Size(cvRound(region.width * scale),
+                        cvRound(region.height * scale)),
+               0, 0, cv::INTER_AREA);
+    return result;
+}
+
+void FaceTracker::init(const cv::Mat &gray, const cv::Rect &rect)
+{
+    cv::Rect face = rect & cv::Rect(0, 0, gray.cols, gray.rows);
+    if (face.width < 8 || face.height < 8) {
+        reset();
+        return;
+    }
+
+    scale = cv::min(1.0, (double)templateWidth / face.width);
+    lastRect = face;
+    faceTemplate = scaled(gray, face);
+    tracking = true;
+}
+
+double FaceTracker::update(const cv::Mat &gray, cv::Rect &rect)
+{
+    if (!tracking) {
+        return -1;
+    }
+
+    int marginX = cvRound(lastRect.width * searchMargin);
+    int marginY = cvRound(lastRect.height * searchMargin);
+    cv::Rect window(lastRect.x - marginX, lastRect.y - marginY,
+                    lastRect.width + 2 * marginX,
+                    lastRect.height + 2 * marginY);
+    window &= cv::Rect(0, 0, gray.cols, gray.rows);
+
+    cv::Mat search = scaled(gray, window);
+    if (search.cols < faceTemplate.cols || search.rows < faceTemplate.rows) {
+        // the face moved out of the frame
+        reset();
+        return -1;
+    }
+
+    cv::Mat response;
+    cv::matchTemplate(search, faceTemplate, response, cv::TM_CCOEFF_NORMED);
+    double confidence;
+    cv::Point best;
+    cv::minMaxLoc(response, NULL, &confidence, NULL, &best);
+
+    cv::Rect found(window.x + cvRound(best.x / scale),
+                   window.y + cvRound(best.y / scale), lastRect.width,
+                   lastRect.height);
+    found &= cv::Rect(0, 0, gray.cols, gray.rows);
+    if (found.width < lastRect.width / 2 || found.height < lastRect.height / 2) {
+        reset();
+        return -1;
+    }
+
+    lastRect = found;
+    rect = found;
+    if (confidence >= refreshConfidence) {
+        faceTemplate = scaled(gray, found);
+    }
+    return confidence;
+}
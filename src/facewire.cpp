@@ -0,0 +1,156 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "facewire.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+// sanity limits so a corrupt peer cannot make us allocate without bound
+static const uint64_t maxPayload = 1ULL << 30;
+static const uint32_t maxMetrics = 4096;
+static const uint32_t maxName = 1024;
+
+bool FaceWire::writeAll(int fd, const void *data, size_t size)
+{
+    const char *cur = (const char *)data;
+    while (size > 0) {
+        // MSG_NOSIGNAL - a worker or client going away must not raise SIGPIPE
+        ssize_t written = send(fd, cur, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == ENOTSOCK) {
+            written = write(fd, cur, size);
+        }
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        cur += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool FaceWire::readAll(int fd, void *data, size_t size)
+{
+    char *cur = (char *)data;
+    while (size > 0) {
+        ssize_t got = read(fd, cur, size);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (got == 0) {
+            return false;
+        }
+        cur += got;
+        size -= got;
+    }
+    return true;
+}
+
+std::string FaceWire::encodeSharedImage(const SharedImage &image,
+                                        const std::string &shmName)
+{
+    std::string payload((const char *)&image, sizeof(image));
+    return payload + shmName;
+}
+
+bool FaceWire::decodeSharedImage(const std::string &payload,
+                                 SharedImage &image, std::string &shmName)
+{
+    if (payload.size() <= sizeof(image) ||
+        payload.size() - sizeof(image) > maxName) {
+        return false;
+    }
+    memcpy(&image, payload.data(), sizeof(image));
+    shmName = payload.substr(sizeof(image));
+    return true;
+}
+
+bool FaceWire::writeRequest(int fd, const Request &request)
+{
+    uint64_t length = request.payload.size();
+    return writeAll(fd, &request.kind, sizeof(request.kind)) &&
+           writeAll(fd, &request.mode, sizeof(request.mode)) &&
+           writeAll(fd, &length, sizeof(length)) &&
+           writeAll(fd, request.payload.data(), request.payload.size());
+}
+
+bool FaceWire::readRequest(int fd, Request &request)
+{
+    uint64_t length;
+    if (!readAll(fd, &request.kind, sizeof(request.kind)) ||
+        !readAll(fd, &request.mode, sizeof(request.mode)) ||
+        !readAll(fd, &length, sizeof(length)) || length > maxPayload) {
+        return false;
+    }
+    request.payload.resize(length);
+    return length == 0 || readAll(fd, &request.payload[0], length);
+}
+
+bool FaceWire::writeResponse(int fd, const Response &response)
+{
+    // built up front so the response goes out in a single write
+    std::vector<char> buffer;
+    buffer.insert(buffer.end(), (const char *)&response.status,
+                  (const char *)&response.status + sizeof(response.status));
+    buffer.insert(buffer.end(), (const char *)&response.quality,
+                  (const char *)&response.quality + sizeof(response.quality));
+    uint32_t count = (uint32_t)response.metrics.size();
+    buffer.insert(buffer.end(), (const char *)&count,
+                  (const char *)&count + sizeof(count));
+
+    std::map<std::string, double>::const_iterator it;
+    for (it = response.metrics.begin(); it != response.metrics.end(); ++it) {
+        uint32_t nameLength = (uint32_t)it->first.size();
+        buffer.insert(buffer.end(), (const char *)&nameLength,
+                      (const char *)&nameLength + sizeof(nameLength));
+        buffer.insert(buffer.end(), it->first.begin(), it->first.end());
+        buffer.insert(buffer.end(), (const char *)&it->second,
+                      (const char *)&it->second + sizeof(it->second));
+    }
+
+    return writeAll(fd, buffer.data(), buffer.size());
+}
+
+bool FaceWire::readResponse(int fd, Response &response)
+{
+    uint32_t count;
+    if (!readAll(fd, &response.status, sizeof(response.status)) ||
+        !readAll(fd, &response.quality, sizeof(response.quality)) ||
+        !readAll(fd, &count, sizeof(count)) || count > maxMetrics) {
+        return false;
+    }
+
+    response.metrics.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t nameLength;
+        double value;
+        if (!readAll(fd, &nameLength, sizeof(nameLength)) ||
+            nameLength > maxName) {
+            return false;
+        }
+        std::string name(nameLength, '\0');
+        if ((nameLength > 0 && !readAll(fd, &name[0], nameLength)) ||
+            !readAll(fd, &value, sizeof(value))) {
+            return false;
+        }
+        response.metrics[name] = value;
+    }
+    return true;
+}
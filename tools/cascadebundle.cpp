@@ -0,0 +1,149 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "cascadebundle.h"
+#include "opencv2/core/core.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Builds the cascade bundle loaded by CvLandmarker::initialize.
+ *
+ * usage: biqt-face-cascade-bundle <output> <config dir> <cascade>...
+ *
+ * each cascade is given relative to the config dir, which is also the key it
+ * is stored under in the bundle.
+ */
+
+static bool readFile(const std::string &path, std::string &contents)
+{
+    std::ifstream in(path.c_str(), std::ifstream::binary);
+    if (!in) {
+        return false;
+    }
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    contents = ss.str();
+    return true;
+}
+
+// drops xml comments and indentation - neither is needed by FileStorage
+static std::string compact(const std::string &xml)
+{
+    std::string out;
+    out.reserve(xml.size());
+    bool lineStart = true;
+    for (size_t i = 0; i < xml.size(); i++) {
+        if (xml.compare(i, 4, "<!--") == 0) {
+            size_t close = xml.find("-->", i + 4);
+            if (close == std::string::npos) {
+                break;
+            }
+            i = close + 2;
+            continue;
+        }
+        char c = xml[i];
+        if (lineStart && (c == ' ' || c == '\t')) {
+            continue;
+        }
+        if (c == '\n' && lineStart) {
+            continue;
+        }
+        lineStart = (c == '\n');
+        out += c;
+    }
+    return out;
+}
+
+static bool isCurrentFormat(const std::string &xml)
+{
+    cv::FileStorage fs(xml, cv::FileStorage::READ | cv::FileStorage::MEMORY);
+    cv::CascadeClassifier classifier;
+    return fs.isOpened() && classifier.read(fs.getFirstTopLevelNode());
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4) {
+        std::cerr << "usage: " << argv[0]
+                  << " <output> <config dir> <cascade>..." << std::endl;
+        return 1;
+    }
+
+    std::string output = argv[1];
+    std::string configDir = argv[2];
+
+    std::vector<CascadeBundle::Entry> entries;
+    for (int i = 3; i < argc; i++) {
+        CascadeBundle::Entry entry;
+        entry.name = argv[i];
+        std::string xmlPath = configDir + "/" + entry.name;
+
+        std::string xml;
+        if (!readFile(xmlPath, xml)) {
+            std::cerr << "Failed to read cascade: " << xmlPath << std::endl;
+            return 1;
+        }
+        struct stat st;
+        if (stat(xmlPath.c_str(), &st) != 0) {
+            std::cerr << "Failed to stat cascade: " << xmlPath << std::endl;
+            return 1;
+        }
+        entry.sourceSize = xml.size();
+        entry.sourceMtime = (int64_t)st.st_mtime;
+        entry.sourceHash = CascadeBundle::hash(xml);
+
+        if (!isCurrentFormat(xml)) {
+            // old haar format - let opencv convert it once, here, instead of
+            // on every load
+            char tmpPath[] = "/tmp/biqt-face-cascadeXXXXXX";
+            int fd = mkstemp(tmpPath);
+            if (fd < 0) {
+                std::cerr << "Failed to create a temporary file" << std::endl;
+                return 1;
+            }
+            close(fd);
+            std::string converted = std::string(tmpPath) + ".xml";
+            bool ok = cv::CascadeClassifier::convert(xmlPath, converted) &&
+                      readFile(converted, xml);
+            remove(converted.c_str());
+            remove(tmpPath);
+            if (!ok) {
+                std::cerr << "Failed to convert cascade: " << xmlPath
+                          << std::endl;
+                return 1;
+            }
+        }
+
+        entry.payload = compact(xml);
+        if (!isCurrentFormat(entry.payload)) {
+            std::cerr << "Bundled cascade does not load: " << xmlPath
+                      << std::endl;
+            return 1;
+        }
+
+        std::cerr << entry.name << ": " << entry.sourceSize << " -> "
+                  << entry.payload.size() << " bytes" << std::endl;
+        entries.push_back(entry);
+    }
+
+    if (!CascadeBundle::write(output, entries)) {
+        std::cerr << "Failed to write cascade bundle: " << output << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
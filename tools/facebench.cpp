@@ -0,0 +1,225 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "brlandmarker.h"
+#include "cvlandmarker.h"
+#include "cvskincolorcbcr.h"
+#include "facemetrics.h"
+#include "facesimd.h"
+#include "facetiming.h"
+#include "syntheticface.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <json/json.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Micro-benchmarks of the pipeline stages on synthetic portraits at the SAP
+ * 30, 40 and 50 image sizes, gray and BGR, of 8 and 16 bits.
+ *
+ * usage: biqt-face-bench [iterations] [output.json]
+ *
+ * the pixel metrics always run. Detection, each cascade and OpenBR only run
+ * with BIQT_HOME pointing at the biqt install holding providers/BIQTFace,
+ * and only on the 8-bit images they are given by the provider.
+ * Results go to stdout unless an output file is given. The kernels of the
+ * optimized backend are measured unless BIQT_FACE_REFERENCE_KERNELS is set.
+ */
+
+typedef std::map<std::string, std::vector<double>> Samples;
+
+template <typename F> static double secondsOf(F run)
+{
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+// per stage statistics of the timed iterations, in milliseconds
+static Json::Value summarize(const std::string &stage,
+                             std::vector<double> &seconds)
+{
+    std::sort(seconds.begin(), seconds.end());
+    double total = 0;
+    for (size_t i = 0; i < seconds.size(); i++) {
+        total += seconds[i];
+    }
+
+    Json::Value result;
+    result["stage"] = stage;
+    result["iterations"] = (Json::UInt)seconds.size();
+    result["min_ms"] = seconds.front() * 1e3;
+    result["median_ms"] = seconds[seconds.size() / 2] * 1e3;
+    result["mean_ms"] = total / seconds.size() * 1e3;
+    result["p99_ms"] = seconds[(seconds.size() * 99) / 100] * 1e3;
+    result["max_ms"] = seconds.back() * 1e3;
+    return result;
+}
+
+static void benchmarkMetrics(const cv::Mat &img, const cv::Rect &faceRect,
+                             Samples &samples)
+{
+    cv::Mat face = img(faceRect);
+    cv::Mat mask;
+    cv::Point2f center;
+    double deviation, grayness;
+    FaceMetrics::Planes planes;
+
+    samples["cvSkinColorCrCb"].push_back(
+        secondsOf([&]() { cvSkinColorCrCb(img, mask); }));
+    samples["setSkinFull"].push_back(
+        secondsOf([&]() { FaceMetrics::skin(img); }));
+    samples["setFaceOffset"].push_back(
+        secondsOf([&]() { FaceMetrics::skin(face, &center); }));
+    samples["setBackground"].push_back(secondsOf(
+        [&]() { FaceMetrics::background(img, deviation, grayness); }));
+    // the fused planes are only built from 8-bit BGR
+    if (img.channels() == 3 && img.depth() == CV_8U) {
+        samples["convertPlanes"].push_back(secondsOf([&]() {
+            FaceMetrics::convert(img, FaceMetrics::ALL_PLANES, planes);
+        }));
+    }
+    samples["setOverExposure"].push_back(
+        secondsOf([&]() { FaceMetrics::overExposure(img); }));
+    samples["setBlur"].push_back(secondsOf([&]() { FaceMetrics::blur(img); }));
+    samples["setFocus"].push_back(
+        secondsOf([&]() { FaceMetrics::focus(img); }));
+}
+
+static void benchmarkModels(const cv::Mat &img, const cv::Rect &faceRect,
+                            CvLandmarker &cvLandmarker,
+                            BrLandmarker &brLandmarker, Samples &samples)
+{
+    cv::Mat gray;
+    bool isProfile;
+
+    // the landmark cascades are run on the drawn face whether or not the
+    // face cascades find it, so each of them is always measured
+    FaceTiming::beginImage();
+    samples["detectFaces"].push_back(secondsOf([&]() {
+        cvLandmarker.prepareGray(img, gray);
+        cvLandmarker.detectFaces(img, gray, isProfile);
+    }));
+    samples["landmarkFace"].push_back(secondsOf(
+        [&]() { cvLandmarker.landmarkFace(img, gray, faceRect); }));
+    brLandmarker.registerImage(img,
+                               QRectF(faceRect.x, faceRect.y, faceRect.width,
+                                      faceRect.height),
+                               true, true);
+
+    // gray, each detectMultiScale and registerImage
+    std::map<std::string, double> times;
+    FaceTiming::imageTimes(times);
+    std::map<std::string, double>::const_iterator it;
+    for (it = times.begin(); it != times.end(); ++it) {
+        samples[it->first].push_back(it->second);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 10;
+    if (iterations < 1) {
+        std::cerr << "usage: " << argv[0] << " [iterations] [output.json]"
+                  << std::endl;
+        return 1;
+    }
+
+    CvLandmarker cvLandmarker;
+    BrLandmarker brLandmarker;
+    bool models = getenv("BIQT_HOME") != NULL && cvLandmarker.initialize("");
+    if (models) {
+        brLandmarker.initialize("");
+        cvLandmarker.warmUp(true);
+        brLandmarker.warmUp();
+    }
+    else {
+        std::cerr << "BIQT_HOME not set or the cascades are missing - only "
+                     "the pixel metrics are measured"
+                  << std::endl;
+    }
+    FaceTiming::setEnabled(true);
+    if (getenv("BIQT_FACE_REFERENCE_KERNELS") != NULL) {
+        FaceMetrics::setBackend(FaceMetrics::REFERENCE);
+    }
+
+    Json::Value root;
+    root["iterations"] = iterations;
+    root["backend"] = FaceMetrics::backend() == FaceMetrics::REFERENCE
+                          ? "reference"
+                          : "optimized";
+    root["simd"] = FaceSimd::name(FaceSimd::level());
+    root["models"] = models;
+    root["results"] = Json::Value(Json::arrayValue);
+
+    const int channelCounts[] = {1, 3};
+    const int depths[] = {8, 16};
+    for (int s = 0; s < sapSizeCount; s++) {
+        for (int f = 0; f < 4; f++) {
+            int channels = channelCounts[f % 2], depth = depths[f / 2];
+            cv::Rect faceRect;
+            cv::Mat img = syntheticImage(
+                cv::Size(sapSizes[s].width, sapSizes[s].height), channels, 1,
+                true, &faceRect);
+            if (depth == 16) {
+                // the 8-bit portrait spread over the 16-bit range
+                img.convertTo(img, CV_16U, 257);
+            }
+
+            // the first pass only warms the caches and allocator
+            Samples samples;
+            for (int i = 0; i <= iterations; i++) {
+                if (i == 1) {
+                    samples.clear();
+                }
+                benchmarkMetrics(img, faceRect, samples);
+                if (models && depth == 8) {
+                    benchmarkModels(img, faceRect, cvLandmarker, brLandmarker,
+                                    samples);
+                }
+            }
+
+            Samples::iterator it;
+            for (it = samples.begin(); it != samples.end(); ++it) {
+                Json::Value result = summarize(it->first, it->second);
+                result["size"] = sapSizes[s].name;
+                result["width"] = img.cols;
+                result["height"] = img.rows;
+                result["channels"] = channels;
+                result["depth"] = depth;
+                root["results"].append(result);
+            }
+            std::cerr << sapSizes[s].name << " " << channels
+                      << " channel(s) " << depth << "-bit done" << std::endl;
+        }
+    }
+
+    if (argc > 2) {
+        std::ofstream out(argv[2]);
+        out << root;
+        if (!out) {
+            std::cerr << "Failed to write " << argv[2] << std::endl;
+            return 1;
+        }
+    }
+    else {
+        std::cout << root;
+    }
+    return 0;
+}
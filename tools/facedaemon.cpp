@@ -0,0 +1,81 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "facedaemon.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <pthread.h>
+#include <thread>
+
+/*
+ * usage: biqt-face-daemon <socket path> [workers] [max clients]
+ *
+ * runs until SIGINT or SIGTERM. BIQT_HOME must point at the biqt install
+ * holding providers/BIQTFace. The workers default to BIQT_FACE_WORKERS, or
+ * 1, and BIQT_FACE_THREADS_PER_WORKER and BIQT_FACE_PINNING apply to them
+ * as they do to the provider's.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0]
+                  << " <socket path> [workers] [max clients]" << std::endl;
+        return 1;
+    }
+    if (getenv("BIQT_HOME") == NULL) {
+        std::cerr << "BIQT_HOME must be set" << std::endl;
+        return 1;
+    }
+
+    FaceThreads::Budget budget;
+    const char *workers = argc > 2 ? argv[2] : getenv("BIQT_FACE_WORKERS");
+    const char *threads = getenv("BIQT_FACE_THREADS_PER_WORKER");
+    const char *pinning = getenv("BIQT_FACE_PINNING");
+    budget.workers = workers != NULL ? atoi(workers) : 1;
+    if (threads != NULL) {
+        budget.threadsPerWorker = atoi(threads);
+    }
+    if (pinning != NULL &&
+        !FaceThreads::parsePinning(pinning, budget.pinning)) {
+        std::cerr << "Ignoring BIQT_FACE_PINNING=" << pinning
+                  << ", expected none, cores or numa" << std::endl;
+    }
+
+    int maxClients = argc > 3 ? atoi(argv[3]) : 4 * budget.workers;
+    if (budget.workers < 1 || maxClients < 1) {
+        std::cerr << "workers and max clients must be positive" << std::endl;
+        return 1;
+    }
+
+    FaceDaemon daemon;
+    if (!daemon.start(argv[1], budget, maxClients)) {
+        return 1;
+    }
+
+    // the workers exist now, so the signals can be routed to this thread
+    // without the workers inheriting the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::thread server(&FaceDaemon::run, &daemon);
+    int received;
+    sigwait(&signals, &received);
+
+    std::cerr << "Stopping BIQTFace daemon" << std::endl;
+    daemon.stop();
+    server.join();
+    return 0;
+}
@@ -0,0 +1,435 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "cvskincolorcbcr.h"
+#include "facemetrics.h"
+#include "facesimd.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "syntheticface.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+/*
+ * Runs the Reference and Optimized metric backends over randomized and
+ * synthetic images and reports the largest deviation between them per metric.
+ *
+ * usage: biqt-face-equivalence [random images] [seed]
+ *
+ * the images are compared with every SIMD level the CPU supports, then once
+ * more with the optimized kernels tiled. Exits with 1 when a deviation
+ * exceeds the tolerance declared for the metric below. Neither OpenBR nor
+ * the cascades are needed.
+ */
+
+// few enough that the SAP images span many tiles, odd to leave partial ones
+static const int tileRows = 37;
+
+struct Metric {
+    const char *name;
+    // the largest deviation the optimized backend may have
+    double tolerance;
+    double maxDeviation;
+    int compared;
+    std::string worstImage;
+};
+
+enum MetricIndex {
+    OVER_EXPOSURE,
+    FOCUS,
+    BLUR,
+    SKIN_MASK,
+    SKIN,
+    SKIN_CENTER_X,
+    SKIN_CENTER_Y,
+    BG_DEVIATION,
+    BG_GRAYNESS,
+    PLANE_GRAY,
+    PLANE_OVER_EXPOSURE,
+    PLANE_SKIN,
+    FORMAT_BGRA,
+    FORMAT_GRAY,
+    DEPTH_OVER_EXPOSURE,
+    DEPTH_FOCUS,
+    DEPTH_BLUR,
+    DEPTH_SKIN,
+    DEPTH_BACKGROUND,
+    METRIC_COUNT
+};
+
+/*
+ * the formats the reference does not take are compared with the 8-bit BGR it
+ * does. A 16-bit image only agrees with the 8-bit one it was made from up to
+ * the rounding of the 8-bit conversions, so its over-exposure and skin are
+ * compared with the 16-bit references below instead, in pixels per 100000
+ * (see pixelDeviation). Skin may differ where the exact chroma is within the
+ * fixed point rounding of the kernel of a half, a handful of pixels per image.
+ */
+static Metric metrics[METRIC_COUNT] = {
+    {"overExposure", 0, 0, 0, ""},    {"focus", 0, 0, 0, ""},
+    {"blur", 0, 0, 0, ""},            {"cvSkinColorCrCb", 0, 0, 0, ""},
+    {"skin", 0, 0, 0, ""},            {"skinCenterX", 0, 0, 0, ""},
+    {"skinCenterY", 0, 0, 0, ""},     {"BGDeviation", 0, 0, 0, ""},
+    {"BGGrayness", 0, 0, 0, ""},      {"planes gray", 0, 0, 0, ""},
+    {"planes overExp", 0, 0, 0, ""},  {"planes skin", 0, 0, 0, ""},
+    {"BGRA", 0, 0, 0, ""},            {"gray as BGR", 0, 0, 0, ""},
+    {"16-bit overExp", 2, 0, 0, ""},  {"16-bit focus", 1e-3, 0, 0, ""},
+    {"16-bit blur", 0.5, 0, 0, ""},   {"16-bit skin", 16, 0, 0, ""},
+    {"16-bit BG", 1e-6, 0, 0, ""}};
+
+// focus sums the gradient magnitude per tile, which rounds differently
+static Metric tiledMetrics[METRIC_COUNT] = {
+    {"overExposure", 0, 0, 0, ""},    {"focus", 1e-6, 0, 0, ""},
+    {"blur", 0, 0, 0, ""},            {"cvSkinColorCrCb", 0, 0, 0, ""},
+    {"skin", 0, 0, 0, ""},            {"skinCenterX", 0, 0, 0, ""},
+    {"skinCenterY", 0, 0, 0, ""},     {"BGDeviation", 0, 0, 0, ""},
+    {"BGGrayness", 0, 0, 0, ""},      {"planes gray", 0, 0, 0, ""},
+    {"planes overExp", 0, 0, 0, ""},  {"planes skin", 0, 0, 0, ""},
+    {"BGRA", 1e-6, 0, 0, ""},         {"gray as BGR", 0, 0, 0, ""},
+    {"16-bit overExp", 2, 0, 0, ""},  {"16-bit focus", 1e-3, 0, 0, ""},
+    {"16-bit blur", 0.5, 0, 0, ""},   {"16-bit skin", 16, 0, 0, ""},
+    {"16-bit BG", 1e-6, 0, 0, ""}};
+
+// the table of the pass being run
+static Metric *current = metrics;
+
+static void compare(MetricIndex index, double reference, double optimized,
+                    const std::string &image)
+{
+    double deviation;
+    if (std::isnan(reference) || std::isnan(optimized)) {
+        deviation = std::isnan(reference) == std::isnan(optimized)
+                        ? 0
+                        : std::numeric_limits<double>::infinity();
+    }
+    else {
+        deviation = std::fabs(reference - optimized);
+    }
+
+    Metric &metric = current[index];
+    metric.compared++;
+    if (deviation > metric.maxDeviation || metric.worstImage.empty()) {
+        metric.maxDeviation = std::max(deviation, metric.maxDeviation);
+        metric.worstImage =
+            image + " [" + FaceSimd::name(FaceSimd::level()) + "]";
+    }
+}
+
+static void compareAll(const cv::Mat &img, const std::string &image)
+{
+    namespace Ref = FaceMetrics::Reference;
+    namespace Opt = FaceMetrics::Optimized;
+
+    // the reference has no over-exposure of gray or BGRA and no blur of BGRA
+    if (img.channels() == 3) {
+        compare(OVER_EXPOSURE, Ref::overExposure(img), Opt::overExposure(img),
+                image);
+    }
+    compare(FOCUS, Ref::focus(img), Opt::focus(img), image);
+    if (img.channels() <= 3) {
+        compare(BLUR, Ref::blur(img), Opt::blur(img), image);
+    }
+
+    // the YCrCb conversion and the background need a color image
+    if (img.channels() < 3) {
+        return;
+    }
+
+    cv::Mat refMask, optMask;
+    cvSkinColorCrCbReference(img, refMask);
+    cvSkinColorCrCbTable(img, optMask);
+    // the fraction of pixels that differ
+    cv::Mat differ = refMask != optMask;
+    compare(SKIN_MASK, 0, (double)countNonZero(differ) / differ.total(),
+            image);
+
+    cv::Point2f refCenter, optCenter;
+    compare(SKIN, Ref::skin(img, &refCenter), Opt::skin(img, &optCenter),
+            image);
+    compare(SKIN_CENTER_X, refCenter.x, optCenter.x, image);
+    compare(SKIN_CENTER_Y, refCenter.y, optCenter.y, image);
+
+    // the fused planes, of the whole image and of its center
+    FaceMetrics::Planes planes;
+    if (FaceMetrics::convert(img, FaceMetrics::ALL_PLANES, planes)) {
+        cv::Mat gray;
+        cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+        cv::Mat differ = gray != planes.gray;
+        compare(PLANE_GRAY, 0, (double)countNonZero(differ) / differ.total(),
+                image);
+
+        cv::Rect center(img.cols / 4, img.rows / 4, std::max(img.cols / 2, 1),
+                        std::max(img.rows / 2, 1));
+        compare(PLANE_OVER_EXPOSURE, Ref::overExposure(img),
+                FaceMetrics::overExposure(planes), image);
+        compare(PLANE_OVER_EXPOSURE, Ref::overExposure(img(center)),
+                FaceMetrics::overExposure(planes, center), image);
+        compare(PLANE_SKIN, Ref::skin(img), FaceMetrics::skin(planes), image);
+        cv::Point2f planesCenter;
+        compare(PLANE_SKIN, Ref::skin(img(center), &refCenter),
+                FaceMetrics::skin(planes, center, &planesCenter), image);
+        compare(PLANE_SKIN, refCenter.x, planesCenter.x, image);
+        compare(PLANE_SKIN, refCenter.y, planesCenter.y, image);
+    }
+
+    double refDeviation, refGrayness, optDeviation, optGrayness;
+    Ref::background(img, refDeviation, refGrayness);
+    Opt::background(img, optDeviation, optGrayness);
+    compare(BG_DEVIATION, refDeviation, optDeviation, image);
+    compare(BG_GRAYNESS, refGrayness, optGrayness, image);
+}
+
+// pixels of an image of total pixels, per 100000 for larger images
+static double pixelDeviation(double pixels, size_t total)
+{
+    return pixels * 1e5 / std::max((double)total, 1e5);
+}
+
+/*
+ * the over-exposed pixels of a 16-bit image, by the test of the reference on
+ * the float Lab of cvtColor - there is no 16-bit Lab - in its 8-bit scale
+ */
+static long referenceOverExposed16(const cv::Mat &wide)
+{
+    cv::Mat bgr, scaled, lab;
+    if (wide.channels() == 1) {
+        cvtColor(wide, bgr, cv::COLOR_GRAY2BGR);
+    }
+    else if (wide.channels() == 4) {
+        cvtColor(wide, bgr, cv::COLOR_BGRA2BGR);
+    }
+    else {
+        bgr = wide;
+    }
+    bgr.convertTo(scaled, CV_32F, 1.0 / 65535);
+    cvtColor(scaled, lab, cv::COLOR_BGR2Lab);
+
+    const double sigma = 1.0 / 60.0;
+    long bad = 0;
+    for (int y = 0; y < lab.rows; y++) {
+        const float *p = lab.ptr<float>(y);
+        for (int x = 0; x < lab.cols; x++, p += 3) {
+            double L = p[0] * 255 / 100;
+            double ab = std::hypot(p[1] + 128.0, p[2] + 128.0);
+            double P = 0.5 * (std::tanh(sigma * ((L - 80) + (40 - ab))) + 1);
+            bad += P > 0.5;
+        }
+    }
+    return bad;
+}
+
+/*
+ * the skin mask of a 16-bit image: the chroma of cvtColor's BGR2YCrCb in
+ * double, at the scale of 8 bits and rounded once, looked up in the table
+ */
+static void referenceSkinMask16(const cv::Mat &wide, cv::Mat &mask)
+{
+    const uchar *table = cvSkinColorCrCbLookup();
+    const int cn = wide.channels();
+    mask.create(wide.rows, wide.cols, CV_8U);
+    for (int y = 0; y < wide.rows; y++) {
+        const ushort *p = wide.ptr<ushort>(y);
+        for (int x = 0; x < wide.cols; x++, p += cn) {
+            double b = p[0], g = p[cn > 1 ? 1 : 0], r = p[cn > 1 ? 2 : 0];
+            double luma = 0.299 * r + 0.587 * g + 0.114 * b;
+            int cr = cv::saturate_cast<uchar>((r - luma) * 0.713 / 257 + 128);
+            int cb = cv::saturate_cast<uchar>((b - luma) * 0.564 / 257 + 128);
+            mask.at<uchar>(y, x) = table[cr * 256 + cb];
+        }
+    }
+}
+
+/*
+ * the formats only the optimized kernels take: BGRA and gray against the
+ * reference of the BGR image they hold, 16 bits against 8. Flat images, and
+ * those too small for a flipped pixel to be a small fraction, are left out
+ * of the latter.
+ */
+static void compareFormats(const cv::Mat &img, const std::string &image,
+                           bool flat)
+{
+    namespace Ref = FaceMetrics::Reference;
+    namespace Opt = FaceMetrics::Optimized;
+
+    double refDeviation, refGrayness, optDeviation, optGrayness;
+    if (img.channels() == 3) {
+        cv::Mat bgra;
+        cvtColor(img, bgra, cv::COLOR_BGR2BGRA);
+        compare(FORMAT_BGRA, Ref::overExposure(img), Opt::overExposure(bgra),
+                image);
+        compare(FORMAT_BGRA, Ref::focus(img), Opt::focus(bgra), image);
+        compare(FORMAT_BGRA, Ref::blur(img), Opt::blur(bgra), image);
+        cv::Point2f refCenter, optCenter;
+        compare(FORMAT_BGRA, Ref::skin(img, &refCenter),
+                Opt::skin(bgra, &optCenter), image);
+        compare(FORMAT_BGRA, refCenter.x, optCenter.x, image);
+        compare(FORMAT_BGRA, refCenter.y, optCenter.y, image);
+    }
+    else if (img.channels() == 1) {
+        cv::Mat bgr;
+        cvtColor(img, bgr, cv::COLOR_GRAY2BGR);
+        compare(FORMAT_GRAY, Ref::overExposure(bgr), Opt::overExposure(img),
+                image);
+        compare(FORMAT_GRAY, Ref::skin(bgr), Opt::skin(img), image);
+        Ref::background(bgr, refDeviation, refGrayness);
+        Opt::background(img, optDeviation, optGrayness);
+        compare(FORMAT_GRAY, refDeviation, optDeviation, image);
+        compare(FORMAT_GRAY, refGrayness, optGrayness, image);
+    }
+
+    if (flat || img.total() < 1024) {
+        return;
+    }
+    cv::Mat wide;
+    img.convertTo(wide, CV_16U, 257);
+    double total = (double)wide.total();
+    compare(DEPTH_OVER_EXPOSURE,
+            pixelDeviation(referenceOverExposed16(wide), total),
+            pixelDeviation(Opt::overExposure(wide) * total, total), image);
+    compare(DEPTH_FOCUS, Opt::focus(img), Opt::focus(wide), image);
+    compare(DEPTH_BLUR, Opt::blur(img), Opt::blur(wide), image);
+    cv::Mat refMask, optMask;
+    referenceSkinMask16(wide, refMask);
+    cvSkinColorCrCbTable(wide, optMask);
+    cv::Mat differ = refMask != optMask;
+    compare(DEPTH_SKIN, 0, pixelDeviation(countNonZero(differ), total),
+            image);
+    compare(DEPTH_SKIN, pixelDeviation(countNonZero(refMask), total),
+            pixelDeviation(Opt::skin(wide) * total, total), image);
+    Opt::background(img, refDeviation, refGrayness);
+    Opt::background(wide, optDeviation, optGrayness);
+    compare(DEPTH_BACKGROUND, refDeviation, optDeviation, image);
+    compare(DEPTH_BACKGROUND, refGrayness, optGrayness, image);
+}
+
+/*
+ * noise, smooth noise or a flat color, 1, 3 or 4 channels, of any size from
+ * 1x1 up - and every other one is a view into a larger image, so rows are
+ * not contiguous
+ */
+static cv::Mat randomImage(cv::RNG &rng, std::string &description,
+                           bool &flat)
+{
+    const int channelCounts[] = {1, 3, 4};
+    int channels = channelCounts[rng.uniform(0, 3)];
+    int width = rng.uniform(1, 400);
+    int height = rng.uniform(1, 400);
+    int margin = rng.uniform(0, 2) * rng.uniform(1, 16);
+
+    cv::Mat full(height + 2 * margin, width + 2 * margin,
+                 CV_8UC(channels));
+    int content = rng.uniform(0, 3);
+    if (content == 2) {
+        full = cv::Scalar(rng.uniform(0, 256), rng.uniform(0, 256),
+                          rng.uniform(0, 256), rng.uniform(0, 256));
+    }
+    else {
+        rng.fill(full, cv::RNG::UNIFORM, cv::Scalar::all(0),
+                 cv::Scalar::all(256));
+        if (content == 1) {
+            int side = 2 * rng.uniform(1, 8) + 1;
+            cv::GaussianBlur(full, full, cv::Size(side, side), 0);
+        }
+    }
+
+    char name[96];
+    const char *contents[] = {"noise", "smooth", "flat"};
+    snprintf(name, sizeof(name), "random %dx%dx%d %s%s", width, height,
+             channels, contents[content], margin > 0 ? " view" : "");
+    description = name;
+    flat = content == 2;
+    return full(cv::Rect(margin, margin, width, height));
+}
+
+static void compareImages(int randomImages, uint64_t seed)
+{
+    cv::RNG rng(seed);
+    for (int i = 0; i < randomImages; i++) {
+        std::string description;
+        bool flat;
+        cv::Mat img = randomImage(rng, description, flat);
+        compareAll(img, description);
+        compareFormats(img, description, flat);
+    }
+
+    // the portraits at the SAP sizes, whole and the face only
+    for (int s = 0; s < sapSizeCount; s++) {
+        for (int channels = 1; channels <= 3; channels += 2) {
+            for (int withFace = 0; withFace < 2; withFace++) {
+                cv::Rect face;
+                cv::Mat img = syntheticImage(
+                    cv::Size(sapSizes[s].width, sapSizes[s].height), channels,
+                    seed, withFace != 0, &face);
+                std::string name = std::string(sapSizes[s].name) + " " +
+                                   (channels == 1 ? "gray" : "BGR");
+                compareAll(img, name + (withFace ? " portrait" : " empty"));
+                compareFormats(img, name + (withFace ? " portrait" : " empty"),
+                               false);
+                if (withFace) {
+                    compareAll(img(face), name + " face");
+                    compareFormats(img(face), name + " face", false);
+                }
+            }
+        }
+    }
+
+}
+
+// prints the table and returns whether every metric is within tolerance
+static bool report(const char *title, const Metric *table)
+{
+    bool passed = true;
+    printf("%s\n%-16s %9s %14s %10s  %s\n", title, "metric", "compared",
+           "max deviation", "tolerance", "worst image");
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        const Metric &metric = table[i];
+        bool ok = metric.maxDeviation <= metric.tolerance;
+        passed = passed && ok;
+        printf("%-16s %9d %14.6g %10.3g  %s%s\n", metric.name,
+               metric.compared, metric.maxDeviation, metric.tolerance,
+               metric.worstImage.c_str(), ok ? "" : "  FAILED");
+    }
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    int randomImages = argc > 1 ? atoi(argv[1]) : 200;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (randomImages < 0) {
+        std::cerr << "usage: " << argv[0] << " [random images] [seed]"
+                  << std::endl;
+        return 1;
+    }
+
+    FaceSimd::Level best = FaceSimd::level();
+    for (int level = FaceSimd::SCALAR; level <= FaceSimd::detected();
+         level++) {
+        FaceSimd::setLevel((FaceSimd::Level)level);
+        compareImages(randomImages, seed);
+    }
+    FaceSimd::setLevel(best);
+
+    current = tiledMetrics;
+    FaceMetrics::setTileRows(tileRows);
+    compareImages(randomImages, seed);
+    FaceMetrics::setTileRows(0);
+
+    char tiled[64];
+    snprintf(tiled, sizeof(tiled), "\ntiled, %d rows", tileRows);
+    bool passed = report("whole images", metrics);
+    passed = report(tiled, tiledMetrics) && passed;
+    return passed ? 0 : 1;
+}
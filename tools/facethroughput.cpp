@@ -0,0 +1,344 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "BIQTFace.h"
+#include "facethreads.h"
+#include "opencv2/imgcodecs.hpp"
+#include "syntheticface.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+/*
+ * End-to-end throughput of BIQTFace::evaluate over a synthetic corpus, on one
+ * thread and on several, compared against a stored baseline.
+ *
+ * usage: biqt-face-throughput [options]
+ *   --corpus <dir>              where the corpus is written (biqt-face-corpus)
+ *   --images <n>                corpus size (48)
+ *   --threads <n>               threads of the parallel run (the CPUs the
+ *                               process may use, cgroup quota included)
+ *   --output <file>             the results, stdout by default
+ *   --baseline <file>           baseline to compare against
+ *   --write-baseline            store the results as the baseline instead
+ *   --max-throughput-drop <f>   allowed fractional drop in images/sec (0.10)
+ *   --max-latency-increase <f>  allowed fractional rise in p50/p99 (0.15)
+ *   --max-rss-increase <f>      allowed fractional rise in peak RSS (0.20)
+ *
+ * exits with 2 when a regression beyond the thresholds is found, and with 1
+ * when any image failed to evaluate - such a run is neither compared nor
+ * stored as the baseline. BIQT_HOME must point at the biqt install holding
+ * providers/BIQTFace.
+ */
+
+struct Options {
+    std::string corpus;
+    int images;
+    int threads;
+    std::string output;
+    std::string baseline;
+    bool writeBaseline;
+    double maxThroughputDrop;
+    double maxLatencyIncrease;
+    double maxRssIncrease;
+};
+
+/*
+ * the corpus mixes the SAP sizes (the largest sparingly), gray and BGR, with
+ * and without a face, JPEG and PNG. Existing files are reused.
+ */
+static bool writeCorpus(const Options &options, std::vector<std::string> &files)
+{
+    mkdir(options.corpus.c_str(), 0755);
+    for (int i = 0; i < options.images; i++) {
+        const SapSize &size = sapSizes[i % 8 == 7 ? 2 : i % 2];
+        int channels = (i / 2) % 2 == 0 ? 3 : 1;
+        bool withFace = i % 4 != 3;
+        const char *extension = i % 3 == 2 ? "png" : "jpg";
+
+        char name[64];
+        snprintf(name, sizeof(name), "/synthetic_%03d.%s", i, extension);
+        std::string path = options.corpus + name;
+        files.push_back(path);
+
+        struct stat existing;
+        if (stat(path.c_str(), &existing) == 0) {
+            continue;
+        }
+        cv::Mat img = syntheticImage(cv::Size(size.width, size.height),
+                                     channels, 1000 + i, withFace);
+        if (!cv::imwrite(path, img)) {
+            std::cerr << "Failed to write " << path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static long peakRssKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    // kilobytes on Linux
+    return usage.ru_maxrss;
+}
+
+/*
+ * evaluates every file once with the given number of threads, each with its
+ * own provider. Every provider evaluates one image before the clock starts
+ * so the lazily loaded models are not counted.
+ */
+static Json::Value run(const std::vector<std::string> &files, int threadCount)
+{
+    std::vector<std::unique_ptr<BIQTFace>> providers;
+    for (int i = 0; i < threadCount; i++) {
+        providers.push_back(std::unique_ptr<BIQTFace>(new BIQTFace()));
+        providers.back()->evaluate(files[0]);
+    }
+
+    std::vector<double> latencies(files.size());
+    std::atomic<size_t> next(0);
+    std::atomic<int> failures(0);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threadCount; i++) {
+        BIQTFace *provider = providers[i].get();
+        workers.push_back(std::thread([&, provider]() {
+            size_t index;
+            while ((index = next++) < files.size()) {
+                std::chrono::steady_clock::time_point imageStart =
+                    std::chrono::steady_clock::now();
+                Provider::EvaluationResult result =
+                    provider->evaluate(files[index]);
+                latencies[index] =
+                    std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - imageStart)
+                        .count();
+                if (result.errorCode != 0) {
+                    failures++;
+                }
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    std::sort(latencies.begin(), latencies.end());
+    Json::Value result;
+    result["threads"] = threadCount;
+    result["images"] = (Json::UInt)files.size();
+    result["failures"] = failures.load();
+    result["images_per_second"] = files.size() / seconds;
+    result["p50_ms"] = latencies[latencies.size() / 2] * 1e3;
+    result["p99_ms"] = latencies[(latencies.size() * 99) / 100] * 1e3;
+    // the process peak so far, so it covers every earlier run as well
+    result["peak_rss_kb"] = (Json::Int64)peakRssKb();
+    return result;
+}
+
+// prints and counts the regressions of one run against its baseline
+static int compare(const Json::Value &current, const Json::Value &baseline,
+                   const Options &options)
+{
+    int regressions = 0;
+    std::string label =
+        "threads=" + std::to_string(current["threads"].asInt()) + ": ";
+
+    double base = baseline["images_per_second"].asDouble();
+    double now = current["images_per_second"].asDouble();
+    if (now < base * (1 - options.maxThroughputDrop)) {
+        std::cerr << "REGRESSION " << label << "images_per_second " << now
+                  << " vs baseline " << base << std::endl;
+        regressions++;
+    }
+
+    const char *latencyKeys[] = {"p50_ms", "p99_ms"};
+    for (int i = 0; i < 2; i++) {
+        base = baseline[latencyKeys[i]].asDouble();
+        now = current[latencyKeys[i]].asDouble();
+        if (now > base * (1 + options.maxLatencyIncrease)) {
+            std::cerr << "REGRESSION " << label << latencyKeys[i] << " " << now
+                      << " vs baseline " << base << std::endl;
+            regressions++;
+        }
+    }
+
+    base = baseline["peak_rss_kb"].asDouble();
+    now = current["peak_rss_kb"].asDouble();
+    if (now > base * (1 + options.maxRssIncrease)) {
+        std::cerr << "REGRESSION " << label << "peak_rss_kb " << now
+                  << " vs baseline " << base << std::endl;
+        regressions++;
+    }
+    return regressions;
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    options.corpus = "biqt-face-corpus";
+    options.images = 48;
+    options.threads = FaceThreads::availableCpus();
+    options.writeBaseline = false;
+    options.maxThroughputDrop = 0.10;
+    options.maxLatencyIncrease = 0.15;
+    options.maxRssIncrease = 0.20;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--write-baseline") {
+            options.writeBaseline = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char *value = argv[++i];
+        if (arg == "--corpus") {
+            options.corpus = value;
+        }
+        else if (arg == "--images") {
+            options.images = atoi(value);
+        }
+        else if (arg == "--threads") {
+            options.threads = atoi(value);
+        }
+        else if (arg == "--output") {
+            options.output = value;
+        }
+        else if (arg == "--baseline") {
+            options.baseline = value;
+        }
+        else if (arg == "--max-throughput-drop") {
+            options.maxThroughputDrop = atof(value);
+        }
+        else if (arg == "--max-latency-increase") {
+            options.maxLatencyIncrease = atof(value);
+        }
+        else if (arg == "--max-rss-increase") {
+            options.maxRssIncrease = atof(value);
+        }
+        else {
+            return false;
+        }
+    }
+    return options.images > 0 && options.threads > 0 &&
+           (!options.writeBaseline || !options.baseline.empty());
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--corpus dir] [--images n] [--threads n]"
+                     " [--output file] [--baseline file [--write-baseline]]"
+                     " [--max-throughput-drop f] [--max-latency-increase f]"
+                     " [--max-rss-increase f]"
+                  << std::endl;
+        return 1;
+    }
+    if (getenv("BIQT_HOME") == NULL) {
+        std::cerr << "BIQT_HOME must be set" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> files;
+    if (!writeCorpus(options, files)) {
+        return 1;
+    }
+
+    Json::Value results;
+    results["runs"] = Json::Value(Json::arrayValue);
+    results["runs"].append(run(files, 1));
+    if (options.threads > 1) {
+        results["runs"].append(run(files, options.threads));
+    }
+
+    if (options.output.empty()) {
+        std::cout << results;
+    }
+    else {
+        std::ofstream out(options.output.c_str());
+        out << results;
+    }
+
+    // a run whose evaluations failed is fast for the wrong reason
+    int failures = 0;
+    for (Json::ArrayIndex i = 0; i < results["runs"].size(); i++) {
+        failures += results["runs"][i]["failures"].asInt();
+    }
+    if (failures > 0) {
+        std::cerr << failures << " evaluation(s) failed" << std::endl;
+        return 1;
+    }
+
+    if (options.baseline.empty()) {
+        return 0;
+    }
+    if (options.writeBaseline) {
+        std::ofstream out(options.baseline.c_str());
+        out << results;
+        if (!out) {
+            std::cerr << "Failed to write " << options.baseline << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    Json::Value baseline;
+    std::ifstream in(options.baseline.c_str());
+    try {
+        in >> baseline;
+    }
+    catch (const std::exception &) {
+        in.setstate(std::ios::failbit);
+    }
+    if (!in) {
+        std::cerr << "Failed to read the baseline " << options.baseline
+                  << std::endl;
+        return 1;
+    }
+
+    // runs are matched by thread count, ones missing from either side are
+    // not compared
+    int regressions = 0;
+    const Json::Value &runs = results["runs"];
+    const Json::Value &baseRuns = baseline["runs"];
+    for (Json::ArrayIndex i = 0; i < runs.size(); i++) {
+        for (Json::ArrayIndex j = 0; j < baseRuns.size(); j++) {
+            if (baseRuns[j]["threads"] == runs[i]["threads"]) {
+                regressions += compare(runs[i], baseRuns[j], options);
+            }
+        }
+    }
+    if (regressions > 0) {
+        std::cerr << regressions << " performance regression(s) against "
+                  << options.baseline << std::endl;
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#include "syntheticface.h"
+#include "opencv2/imgproc/imgproc.hpp"
+
+const SapSize sapSizes[] = {
+    {"SAP30", 480, 600}, {"SAP40", 768, 1024}, {"SAP50", 3300, 4400}};
+const int sapSizeCount = sizeof(sapSizes) / sizeof(sapSizes[0]);
+
+cv::Mat syntheticImage(cv::Size size, int channels, uint64_t seed,
+                       bool withFace, cv::Rect *face)
+{
+    cv::RNG rng(seed);
+    int w = size.width, h = size.height;
+
+    // a light, slightly uneven background
+    cv::Mat img(size, CV_8UC3,
+                cv::Scalar(rng.uniform(170, 230), rng.uniform(170, 230),
+                           rng.uniform(170, 230)));
+    cv::rectangle(img, cv::Rect(0, h / 2, w, h - h / 2),
+                  cv::Scalar(rng.uniform(60, 120), rng.uniform(60, 120),
+                             rng.uniform(60, 120)),
+                  cv::FILLED);
+
+    if (face != NULL) {
+        *face = cv::Rect();
+    }
+    if (withFace) {
+        // the head takes about half the width, as on a passport photo
+        int faceW = w * rng.uniform(40, 55) / 100;
+        int faceH = faceW * 4 / 3;
+        cv::Point c(w / 2 + rng.uniform(-w / 20, w / 20 + 1),
+                    h * 9 / 20 + rng.uniform(-h / 20, h / 20 + 1));
+        cv::Scalar skin(rng.uniform(90, 130), rng.uniform(130, 160),
+                        rng.uniform(180, 220));
+        cv::ellipse(img, c, cv::Size(faceW / 2, faceH / 2), 0, 0, 360, skin,
+                    cv::FILLED);
+
+        cv::Scalar dark(40, 40, 50);
+        int eyeY = c.y - faceH / 10;
+        int eyeDX = faceW / 5;
+        for (int side = -1; side <= 1; side += 2) {
+            cv::Point eye(c.x + side * eyeDX, eyeY);
+            cv::ellipse(img, eye, cv::Size(faceW / 12, faceW / 24), 0, 0, 360,
+                        cv::Scalar(240, 240, 240), cv::FILLED);
+            cv::circle(img, eye, faceW / 30, dark, cv::FILLED);
+            cv::ellipse(img, cv::Point(eye.x, eyeY - faceW / 10),
+                        cv::Size(faceW / 10, faceW / 40), 0, 180, 360, dark,
+                        std::max(1, faceW / 60));
+        }
+        cv::ellipse(img, cv::Point(c.x, c.y + faceH / 12),
+                    cv::Size(faceW / 16, faceH / 12), 0, 0, 360,
+                    skin * 0.8, cv::FILLED);
+        cv::ellipse(img, cv::Point(c.x, c.y + faceH / 4),
+                    cv::Size(faceW / 6, faceH / 24), 0, 0, 360,
+                    cv::Scalar(60, 60, 150), cv::FILLED);
+
+        if (face != NULL) {
+            *face = cv::Rect(c.x - faceW / 2, c.y - faceH / 2, faceW, faceH) &
+                    cv::Rect(0, 0, w, h);
+        }
+    }
+
+    // sensor noise and a little softness so no region is perfectly flat
+    cv::Mat noise(size, CV_16SC3);
+    rng.fill(noise, cv::RNG::NORMAL, cv::Scalar::all(0), cv::Scalar::all(6));
+    cv::Mat noisy;
+    img.convertTo(noisy, CV_16SC3);
+    noisy += noise;
+    noisy.convertTo(img, CV_8UC3);
+    cv::GaussianBlur(img, img, cv::Size(3, 3), 0);
+
+    if (channels == 1) {
+        cv::Mat gray;
+        cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+        return gray;
+    }
+    return img;
+}
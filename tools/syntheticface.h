@@ -0,0 +1,37 @@
+// #######################################################################
+// NOTICE
+//
+// This software (or technical data) was produced for the U.S. Government
+// under contract, and is subject to the Rights in Data-General Clause
+// 52.227-14, Alt. IV (DEC 2007).
+//
+// Copyright 2019 The MITRE Corporation. All Rights Reserved.
+// #######################################################################
+
+#ifndef SYNTHETICFACE_H
+#define SYNTHETICFACE_H
+
+#include "opencv2/core/core.hpp"
+#include <string>
+
+/*
+ * Synthetic input for the benchmark tools, so no image dataset is needed.
+ * The same size, channel count and seed always give the same image.
+ */
+
+// the image sizes of the SAP levels (width x height)
+struct SapSize {
+    const char *name;
+    int width;
+    int height;
+};
+extern const SapSize sapSizes[];
+extern const int sapSizeCount;
+
+// a portrait - skin toned face with eyes, brows, nose and mouth in front of
+// a plain background - or only the background with withFace false. face is
+// set to the drawn face, or an empty rect. channels is 1 or 3.
+cv::Mat syntheticImage(cv::Size size, int channels, uint64_t seed,
+                       bool withFace = true, cv::Rect *face = NULL);
+
+#endif // SYNTHETICFACE_H